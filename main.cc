@@ -8,6 +8,26 @@
 #include <cmath>
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <deque>
+#include <condition_variable>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 using std::string;
 using std::vector;
 using std::shared_ptr;
@@ -17,10 +37,171 @@ using std::cerr;
 using std::cin;
 using std::endl;
 
+class Rng {
+    // small xorshift64* generator. each trial owns one, so trials running
+    // side by side share no state and a seed always replays the same draws
+    private:
+        uint64_t state;
+    public:
+        Rng(uint64_t seed = 1){
+            // one splitmix64 step, so neighbouring seeds start far apart
+            uint64_t z = seed + 0x9e3779b97f4a7c15ULL;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            z ^= z >> 31;
+            state = z ? z : 1;
+        }
+        uint32_t next(){
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            return (state * 0x2545f4914f6cdd1dULL) >> 32;
+        }
+        int operator()(int bound){
+            // uniform in [0, bound), the replacement for rand() % bound
+            return ((uint64_t) next() * bound) >> 32;
+        }
+        float uniform(){
+            // uniform in [0, 1)
+            return (next() >> 8) * (1.f / (1 << 24));
+        }
+        void normal_pair(float &a, float &b){
+            // two independent standard normals (Box-Muller)
+            float u = 1.f - uniform(), v = uniform();
+            float r = sqrt(-2.f * log(u)), turn = 6.2831853f * v;
+            a = r * cos(turn);
+            b = r * sin(turn);
+        }
+};
+
+class Instruments {
+    // hot-path counters and phase timers, one set per thread so counting
+    // takes no lock. the STAT_ macros below are the only way the searches
+    // touch them, and they compile to nothing unless ROUTE_STATS is defined.
+    // phase times are inclusive: a swap timed inside try_swap counts in both
+    public:
+        enum class Counter {
+            distance_evaluations, length_refreshes, swap_calls, unswap_calls,
+            try_swap_calls, anyin_subsection_calls,
+            opt2_evaluated, opt2_accepted, opt2_knn_evaluated, opt2_knn_accepted,
+            segment_evaluated, segment_accepted, exchange_evaluated, exchange_accepted,
+            lk_evaluated, lk_accepted, insertion_evaluated, insertion_accepted,
+            anneal_evaluated, anneal_accepted,
+            total
+        };
+        enum class Phase {
+            greedy_route, opt2, opt2_knn, move_segments, lin_kernighan, multi_opt2,
+            try_swap, swap, anyin_subsection, length, insertion, anneal,
+            total
+        };
+
+    private:
+        unsigned long long counts[(int) Counter::total] = {};
+        double seconds[(int) Phase::total] = {};
+        static FILE *out;
+        static std::mutex out_lock;
+
+    public:
+        static Instruments &local(){
+            static thread_local Instruments mine;
+            return mine;
+        }
+
+        static const char *name(Counter c){
+            static const char *names[] = {
+                "distance_evaluations", "length_refreshes", "swap_calls", "unswap_calls",
+                "try_swap_calls", "anyin_subsection_calls",
+                "opt2_evaluated", "opt2_accepted", "opt2_knn_evaluated", "opt2_knn_accepted",
+                "segment_evaluated", "segment_accepted", "exchange_evaluated", "exchange_accepted",
+                "lk_evaluated", "lk_accepted", "insertion_evaluated", "insertion_accepted",
+                "anneal_evaluated", "anneal_accepted"
+            };
+            return names[(int) c];
+        }
+        static const char *name(Phase p){
+            static const char *names[] = {
+                "greedy_route", "opt2", "opt2_knn", "move_segments", "lin_kernighan", "multi_opt2",
+                "try_swap", "swap", "anyin_subsection", "length", "insertion", "anneal"
+            };
+            return names[(int) p];
+        }
+
+        void add(Counter c, unsigned long long n = 1){
+            counts[(int) c] += n;
+        }
+        void add(Phase p, double s){
+            seconds[(int) p] += s;
+        }
+        unsigned long long count(Counter c){
+            return counts[(int) c];
+        }
+        double time(Phase p){
+            return seconds[(int) p];
+        }
+        void reset(){
+            *this = Instruments();
+        }
+
+        static void open(const string &path){
+            // reports from every thread go to path, one JSON object per line
+            std::lock_guard<std::mutex> hold(out_lock);
+            if (out){
+                fclose(out);
+            }
+            out = fopen(path.c_str(), "w");
+        }
+
+        void dump(const string &label){
+            // writes this thread's counts since the last dump and clears them
+            std::lock_guard<std::mutex> hold(out_lock);
+            if (out){
+                fprintf(out, "{\"label\": \"%s\", \"counters\": {", label.c_str());
+                for (int c = 0; c < (int) Counter::total; c++){
+                    fprintf(out, "%s\"%s\": %llu", c ? ", " : "", name((Counter) c), counts[c]);
+                }
+                fprintf(out, "}, \"phases_s\": {");
+                for (int p = 0; p < (int) Phase::total; p++){
+                    fprintf(out, "%s\"%s\": %.9f", p ? ", " : "", name((Phase) p), seconds[p]);
+                }
+                fprintf(out, "}}\n");
+                fflush(out);
+            }
+            reset();
+        }
+};
+FILE *Instruments::out = NULL;
+std::mutex Instruments::out_lock;
+
+class PhaseTimer {
+    // adds the time from construction to destruction to a phase
+    private:
+        Instruments::Phase phase;
+        std::chrono::steady_clock::time_point start;
+    public:
+        PhaseTimer(Instruments::Phase phase): phase(phase), start(std::chrono::steady_clock::now()){}
+        ~PhaseTimer(){
+            Instruments::local().add(phase,
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+};
+
+#ifdef ROUTE_STATS
+#define STAT_COUNT(counter) Instruments::local().add(Instruments::Counter::counter)
+#define STAT_ADD(counter, n) Instruments::local().add(Instruments::Counter::counter, n)
+#define STAT_PHASE(phase) PhaseTimer phase_timer(Instruments::Phase::phase)
+#define STAT_DUMP(label) Instruments::local().dump(label)
+#else
+#define STAT_COUNT(counter) ((void) 0)
+#define STAT_ADD(counter, n) ((void) 0)
+#define STAT_PHASE(phase) ((void) 0)
+#define STAT_DUMP(label) ((void) 0)
+#endif
+
 class Address {
     private:
         float i, j;
         int last_date;
+        int index = -1; // dense index handed out by a DistanceOracle, -1 if none
     public:
         Address(float i, float j): i(i), j(j) {};
         string as_string(){
@@ -44,396 +225,4292 @@ class Address {
         int get_last_date(){
             return last_date;
         }
+        float get_i(){
+            return i;
+        }
+        float get_j(){
+            return j;
+        }
+        int get_index(){
+            return index;
+        }
+        void set_index(int new_index){
+            index = new_index;
+        }
+        uint64_t key(){
+            // exact coordinate bits, with -0 folded onto 0 so that keys agree
+            // with distance() == 0
+            float ki = i == 0 ? 0.f : i, kj = j == 0 ? 0.f : j;
+            uint32_t bi, bj;
+            memcpy(&bi, &ki, sizeof bi);
+            memcpy(&bj, &kj, sizeof bj);
+            return (uint64_t) bi << 32 | bj;
+        }
 };
 
-class AddressList {
-    protected:
-        vector<Address> addresses;
+class DistanceOracle {
+    // hands the first matrix_limit distinct coordinates interned into it a
+    // dense index and keeps a triangular float matrix of the distances
+    // between them, filled as each address is indexed. later coordinates
+    // get no index, and pairs involving them are computed directly.
+    // AddressList and Route do not use it: on their walks a float sqrt is
+    // cheaper than a lookup into a matrix this size, so it is for callers
+    // that evaluate the same small set of pairs many times, and it reports
+    // how often their lookups hit the matrix. each instance belongs to one
+    // thread, like the lists it serves
+    private:
+        int matrix_limit;
+        std::unordered_map<uint64_t, int> index_of;
+        vector<Address> matrix_addresses;
+        std::unique_ptr<float[]> matrix;
+        // intern() calls that found or made a row, and those that did not
+        unsigned long long indexed_interns = 0, unindexed_interns = 0;
+        // distance() calls answered from the matrix, and those computed
+        unsigned long long hits = 0, misses = 0;
+
+        float &matrix_cell(int a, int b){
+            // row r holds the distances from r to indices 0..r
+            if (a < b){
+                std::swap(a, b);
+            }
+            return matrix[(size_t) a * (a + 1) / 2 + b];
+        }
+
     public:
-        AddressList(){
-            addresses = {};
+        DistanceOracle(int matrix_limit = 2048):
+            matrix_limit(matrix_limit),
+            matrix(new float[(size_t) matrix_limit * (matrix_limit + 1) / 2]) {}
+
+        Address intern(Address a){
+            // returns a with its dense index set, indexing it if it is new
+            // and the matrix has room; otherwise a keeps index -1
+            auto found = index_of.find(a.key());
+            if (found != index_of.end()){
+                indexed_interns++;
+                a.set_index(found->second);
+                return a;
+            }
+            int index = index_of.size();
+            if (index >= matrix_limit){
+                unindexed_interns++;
+                a.set_index(-1);
+                return a;
+            }
+            indexed_interns++;
+            index_of[a.key()] = index;
+            a.set_index(index);
+            for (int other = 0; other < index; other++){
+                matrix_cell(index, other) = a.distance(matrix_addresses[other]);
+            }
+            matrix_cell(index, index) = 0;
+            matrix_addresses.push_back(a);
+            return a;
         }
-        AddressList(vector<Address> source){
-            addresses = source;
+
+        float distance(Address &a, Address &b){
+            int ia = a.get_index(), ib = b.get_index();
+            if (ia < 0 or ib < 0){
+                misses++;
+                return a.distance(b);
+            }
+            hits++;
+            return matrix_cell(ia, ib);
         }
-        void clear(){
-            addresses = {};
+
+        int size(){
+            return index_of.size();
         }
-        void add_address(Address newaddress){
-            // adds address a to vector 'addresses' if and only if 
-            // l1 norm of a to all addresses in addresses is not 0
-            if (in(newaddress)){ 
-                //cout << "Address not added; identical to current member" << endl;
-                //cout << "For " <<  newaddress.as_string() << endl;
-                return;
-            } 
-            addresses.push_back(newaddress);
+
+        size_t memory_bytes(){
+            // the whole matrix as allocated (pages are only committed as rows
+            // are filled), the addresses behind it and the index table
+            size_t bytes = (size_t) matrix_limit * (matrix_limit + 1) / 2 * sizeof(float);
+            bytes += matrix_addresses.capacity() * sizeof(Address);
+            bytes += index_of.size() * (sizeof(uint64_t) + sizeof(int) + 2 * sizeof(void *));
+            return bytes;
+        }
+
+        float coverage(){
+            // share of intern() calls that came back with a matrix row
+            unsigned long long total = indexed_interns + unindexed_interns;
+            return total == 0 ? 1.f : (float) indexed_interns / total;
+        }
+
+        float hit_rate(){
+            // share of distance() calls answered from the matrix
+            unsigned long long total = hits + misses;
+            return total == 0 ? 0.f : (float) hits / total;
+        }
+
+        void report(){
+            cout << "distance oracle: " << size() << " addresses in matrix, "
+                << "coverage " << coverage() * 100 << "%, "
+                << "hit rate " << hit_rate() * 100 << "%, "
+                << memory_bytes() << " bytes" << endl;
+        }
+};
+
+struct Coordinates {
+    // structure-of-arrays copy of address coordinates for the nearest kernels
+    vector<float> xs, ys;
+
+    void push_back(Address a){
+        xs.push_back(a.get_i());
+        ys.push_back(a.get_j());
+    }
+    void erase(int p){
+        xs.erase(xs.begin() + p);
+        ys.erase(ys.begin() + p);
+    }
+    int size(){
+        return xs.size();
+    }
+};
+
+// nearest-neighbour kernels: index of the point closest to (x, y), lowest
+// index on ties. squared distances are compared, so no sqrt is needed
+int nearest_scalar(const float *xs, const float *ys, int n, float x, float y){
+    int closest = 0;
+    float min_d2 = std::numeric_limits<float>::max();
+    for (int k = 0; k < n; k++){
+        float dx = xs[k] - x, dy = ys[k] - y;
+        float d2 = dx*dx + dy*dy;
+        if (d2 < min_d2){
+            closest = k;
+            min_d2 = d2;
+        }
+    }
+    return closest;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+int finish_nearest(float *lane_d2, int *lane_index, int lanes, int done,
+    const float *xs, const float *ys, int n, float x, float y){
+    // reduce the per-lane minima (each lane already kept its lowest index),
+    // then scan the tail that did not fill a whole vector
+    int closest = 0;
+    float min_d2 = std::numeric_limits<float>::max();
+    for (int l = 0; l < lanes; l++){
+        if (lane_d2[l] < min_d2 or (lane_d2[l] == min_d2 and lane_index[l] < closest)){
+            closest = lane_index[l];
+            min_d2 = lane_d2[l];
+        }
+    }
+    for (int k = done; k < n; k++){
+        float dx = xs[k] - x, dy = ys[k] - y;
+        float d2 = dx*dx + dy*dy;
+        if (d2 < min_d2){
+            closest = k;
+            min_d2 = d2;
+        }
+    }
+    return closest;
+}
+
+__attribute__((target("sse2")))
+int nearest_sse(const float *xs, const float *ys, int n, float x, float y){
+    __m128 qx = _mm_set1_ps(x), qy = _mm_set1_ps(y);
+    __m128 best = _mm_set1_ps(std::numeric_limits<float>::max());
+    __m128i best_index = _mm_setzero_si128();
+    __m128i index = _mm_setr_epi32(0, 1, 2, 3), step = _mm_set1_epi32(4);
+    int k = 0;
+    for (; k + 4 <= n; k += 4){
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + k), qx);
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(ys + k), qy);
+        __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        __m128 closer = _mm_cmplt_ps(d2, best);
+        best = _mm_or_ps(_mm_and_ps(closer, d2), _mm_andnot_ps(closer, best));
+        __m128i closer_i = _mm_castps_si128(closer);
+        best_index = _mm_or_si128(_mm_and_si128(closer_i, index), _mm_andnot_si128(closer_i, best_index));
+        index = _mm_add_epi32(index, step);
+    }
+    float lane_d2[4];
+    int lane_index[4];
+    _mm_storeu_ps(lane_d2, best);
+    _mm_storeu_si128((__m128i *) lane_index, best_index);
+    return finish_nearest(lane_d2, lane_index, 4, k, xs, ys, n, x, y);
+}
+
+__attribute__((target("avx2")))
+int nearest_avx2(const float *xs, const float *ys, int n, float x, float y){
+    __m256 qx = _mm256_set1_ps(x), qy = _mm256_set1_ps(y);
+    __m256 best = _mm256_set1_ps(std::numeric_limits<float>::max());
+    __m256i best_index = _mm256_setzero_si256();
+    __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), step = _mm256_set1_epi32(8);
+    int k = 0;
+    for (; k + 8 <= n; k += 8){
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(xs + k), qx);
+        __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(ys + k), qy);
+        __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        __m256 closer = _mm256_cmp_ps(d2, best, _CMP_LT_OQ);
+        best = _mm256_blendv_ps(best, d2, closer);
+        best_index = _mm256_blendv_epi8(best_index, index, _mm256_castps_si256(closer));
+        index = _mm256_add_epi32(index, step);
+    }
+    float lane_d2[8];
+    int lane_index[8];
+    _mm256_storeu_ps(lane_d2, best);
+    _mm256_storeu_si256((__m256i *) lane_index, best_index);
+    return finish_nearest(lane_d2, lane_index, 8, k, xs, ys, n, x, y);
+}
+#endif
+
+typedef int (*NearestKernel)(const float *, const float *, int, float, float);
+
+NearestKernel pick_nearest_kernel(){
+    // chosen once at runtime from what the cpu supports
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")){
+        return nearest_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")){
+        return nearest_sse;
+    }
+#endif
+    return nearest_scalar;
+}
+
+int nearest_index(const float *xs, const float *ys, int n, float x, float y){
+    static const NearestKernel kernel = pick_nearest_kernel();
+    return kernel(xs, ys, n, x, y);
+}
+
+int nearest_index(Coordinates &coords, float x, float y){
+    return nearest_index(coords.xs.data(), coords.ys.data(), coords.size(), x, y);
+}
+
+class SpatialGrid {
+    // uniform grid over a point set for nearest, k-nearest and radius
+    // queries. points keep the id they were added with; removed points stop
+    // being returned. the grid is rebuilt coarser as points are removed and
+    // finer (or wider) as points are added, so cells stay near two points each
+    private:
+        Coordinates points;
+        vector<char> live;
+        int live_count = 0;
+        float x0 = 0, y0 = 0, cell = 1;
+        int nx = 1, ny = 1;
+        vector<vector<int>> cells; // ids in each cell, ascending
+
+        int cell_x(float x){
+            return std::min(nx - 1, std::max(0, (int) ((x - x0) / cell)));
+        }
+        int cell_y(float y){
+            return std::min(ny - 1, std::max(0, (int) ((y - y0) / cell)));
+        }
+        bool covers(float x, float y){
+            return x >= x0 and y >= y0 and x <= x0 + nx * cell and y <= y0 + ny * cell;
+        }
+
+        void rebuild(){
+            float x1 = -std::numeric_limits<float>::max(), y1 = x1;
+            x0 = std::numeric_limits<float>::max(); y0 = x0;
+            for (int id = 0; id < points.size(); id++){
+                if (live[id]){
+                    x0 = std::min(x0, points.xs[id]); x1 = std::max(x1, points.xs[id]);
+                    y0 = std::min(y0, points.ys[id]); y1 = std::max(y1, points.ys[id]);
+                }
+            }
+            if (live_count == 0){
+                x0 = y0 = 0; x1 = y1 = 1;
+            }
+            float width = std::max(x1 - x0, 1e-6f), height = std::max(y1 - y0, 1e-6f);
+            int target = std::max(1, live_count / 2);
+            cell = std::max(std::sqrt(width * height / target), std::max(width, height) / target);
+            // one spare cell on each axis so the far edge lands inside the grid
+            nx = (int) (width / cell) + 1;
+            ny = (int) (height / cell) + 1;
+            cells.assign((size_t) nx * ny, {});
+            for (int id = 0; id < points.size(); id++){
+                if (live[id]){
+                    cells[(size_t) cell_y(points.ys[id]) * nx + cell_x(points.xs[id])].push_back(id);
+                }
+            }
+        }
+
+        float ring_bound(float x, float y, int cx, int cy, int r){
+            // distance from (x, y) to the nearest point outside rings 0..r
+            float left = x - (x0 + (cx - r) * cell), right = x0 + (cx + r + 1) * cell - x;
+            float down = y - (y0 + (cy - r) * cell), up = y0 + (cy + r + 1) * cell - y;
+            return std::max(0.f, std::min(std::min(left, right), std::min(down, up)));
+        }
+
+        template <typename Visit>
+        void visit_ring(int cx, int cy, int r, Visit visit){
+            for (int gy = cy - r; gy <= cy + r; gy++){
+                if (gy < 0 or gy >= ny){
+                    continue;
+                }
+                bool edge_row = gy == cy - r or gy == cy + r;
+                for (int gx = cx - r; gx <= cx + r; gx += edge_row ? 1 : 2 * r){
+                    if (gx >= 0 and gx < nx){
+                        for (int id: cells[(size_t) gy * nx + gx]){
+                            visit(id);
+                        }
+                    }
+                    if (r == 0){
+                        break;
+                    }
+                }
+            }
+        }
+
+        float d2(int id, float x, float y){
+            float dx = points.xs[id] - x, dy = points.ys[id] - y;
+            return dx*dx + dy*dy;
+        }
+
+    public:
+        SpatialGrid(){
+            rebuild();
+        }
+        SpatialGrid(Coordinates source): points(source), live(source.size(), 1), live_count(source.size()){
+            rebuild();
         }
+
         int size(){
-            return addresses.size();
+            return live_count;
         }
-        void print(){
-            for (Address a: addresses){
-                a.print();
+
+        int add(float x, float y){
+            // returns the id of the new point
+            int id = points.size();
+            points.xs.push_back(x);
+            points.ys.push_back(y);
+            live.push_back(1);
+            live_count++;
+            if (not covers(x, y) or live_count > 4 * nx * ny){
+                rebuild();
+            } else {
+                vector<int> &bucket = cells[(size_t) cell_y(y) * nx + cell_x(x)];
+                bucket.push_back(id); // ids only grow, so the bucket stays sorted
             }
-            cout << endl;
+            return id;
         }
-        float length(){
-            // returns total length of path if added addresses traversed in order
-            float total = 0;
-            Address last = addresses[0];
-            for (int i = 1; i < addresses.size(); i++){
-                Address curr = addresses[i];
-                total += last.distance(curr);
-                last = curr;
+
+        void remove(int id){
+            if (not live[id]){
+                return;
+            }
+            live[id] = 0;
+            live_count--;
+            vector<int> &bucket = cells[(size_t) cell_y(points.ys[id]) * nx + cell_x(points.xs[id])];
+            bucket.erase(std::lower_bound(bucket.begin(), bucket.end(), id));
+            if (live_count * 8 < nx * ny and nx * ny > 16){
+                rebuild();
             }
-            return total;
         }
-        int index_closest_to(Address a){
-            //Assume a is not represented in the list
-            //ie, no 0 distances allowed
-            int closest = 0;
-            float min_dist = std::numeric_limits<float>::max();
-            for (int i = 0; i < addresses.size(); i++){
-                Address curr = addresses[i];
-                float this_dist;
-                this_dist = a.distance(curr);
-                //set new min if this is closer
-                if(this_dist < min_dist){
-                    closest = i;
-                    min_dist = this_dist;
+
+        int nearest(float x, float y){
+            // closest live point, lowest id on ties; -1 if none are left
+            int best = -1;
+            float best_d2 = std::numeric_limits<float>::max();
+            int cx = cell_x(x), cy = cell_y(y);
+            int max_r = std::max(std::max(cx, nx - 1 - cx), std::max(cy, ny - 1 - cy));
+            for (int r = 0; r <= max_r; r++){
+                visit_ring(cx, cy, r, [&](int id){
+                    float d = d2(id, x, y);
+                    if (d < best_d2 or (d == best_d2 and id < best)){
+                        best = id;
+                        best_d2 = d;
+                    }
+                });
+                float bound = ring_bound(x, y, cx, cy, r);
+                if (best >= 0 and bound * bound > best_d2){
+                    break;
                 }
             }
-            return closest;
+            return best;
         }
-        
-        vector<Address> greedy_route(){
-            vector<Address> result; 
-            Address we_are_here = addresses[0]; // assume depot is first item in address list;
-            // throw the following error otherwise
-            if (we_are_here.distance(Address(0,0)) != 0){
-                throw "First address in address list should be depot (origin)";
+
+        vector<int> k_nearest(float x, float y, int k){
+            // up to k live points ordered by distance, then id
+            vector<std::pair<float, int>> found;
+            int cx = cell_x(x), cy = cell_y(y);
+            int max_r = std::max(std::max(cx, nx - 1 - cx), std::max(cy, ny - 1 - cy));
+            for (int r = 0; r <= max_r and k > 0; r++){
+                visit_ring(cx, cy, r, [&](int id){
+                    found.push_back({d2(id, x, y), id});
+                    std::push_heap(found.begin(), found.end());
+                    if ((int) found.size() > k){
+                        std::pop_heap(found.begin(), found.end());
+                        found.pop_back();
+                    }
+                });
+                float bound = ring_bound(x, y, cx, cy, r);
+                if ((int) found.size() == k and bound * bound > found.front().first){
+                    break;
+                }
             }
-            result.push_back(we_are_here);
-            addresses.erase(addresses.begin());
-            //iterate through 'addresses', append and erase as we go
-            while(addresses.size() > 0){
-                int closest_address_index = index_closest_to(we_are_here);
-                we_are_here = addresses[closest_address_index];
-                result.push_back(we_are_here);
-                addresses.erase(addresses.begin() + closest_address_index);
+            std::sort_heap(found.begin(), found.end());
+            vector<int> ids;
+            for (auto &entry: found){
+                ids.push_back(entry.second);
+            }
+            return ids;
+        }
+
+        vector<int> within(float x, float y, float radius){
+            // live points no further than radius, in id order within each cell
+            vector<int> ids;
+            float r2 = radius * radius;
+            for (int gy = cell_y(y - radius); gy <= cell_y(y + radius); gy++){
+                for (int gx = cell_x(x - radius); gx <= cell_x(x + radius); gx++){
+                    for (int id: cells[(size_t) gy * nx + gx]){
+                        if (d2(id, x, y) <= r2){
+                            ids.push_back(id);
+                        }
+                    }
+                }
+            }
+            return ids;
+        }
+};
+
+class PositionIndex {
+    // the positions of ids in a sequence that grows by insertions anywhere:
+    // an implicit treap with parent links, so position(id) walks from id
+    // up to the root and insert() descends from the root by rank, both in
+    // O(log n) expected. ids are handed out in order, 0..n-1 by build()
+    // and then one more per insert()
+    private:
+        vector<int> left, right, parent, count;
+        vector<uint32_t> priority;
+        int root = -1;
+        Rng rng;
+
+        int size_of(int v){
+            return v < 0 ? 0 : count[v];
+        }
+        int add_node(){
+            left.push_back(-1);
+            right.push_back(-1);
+            parent.push_back(-1);
+            count.push_back(1);
+            priority.push_back(rng.next());
+            return left.size() - 1;
+        }
+        void rotate_up(int x){
+            // x takes its parent's place; in-order is unchanged
+            int y = parent[x], z = parent[y];
+            if (left[y] == x){
+                left[y] = right[x];
+                if (right[x] >= 0){
+                    parent[right[x]] = y;
+                }
+                right[x] = y;
+            } else {
+                right[y] = left[x];
+                if (left[x] >= 0){
+                    parent[left[x]] = y;
+                }
+                left[x] = y;
+            }
+            parent[y] = x;
+            parent[x] = z;
+            if (z < 0){
+                root = x;
+            } else if (left[z] == y){
+                left[z] = x;
+            } else {
+                right[z] = x;
+            }
+            count[y] = 1 + size_of(left[y]) + size_of(right[y]);
+            count[x] = 1 + size_of(left[x]) + size_of(right[x]);
+        }
+
+    public:
+        PositionIndex(): rng(0x5eed) {}
+
+        void build(int n){
+            // ids 0..n-1 at positions 0..n-1, as a Cartesian tree in O(n):
+            // a node's subtree is the run between the nearest higher
+            // priorities on either side, which the stack holds
+            left.clear(); right.clear(); parent.clear(); count.clear(); priority.clear();
+            vector<int> stack;
+            vector<int> first(n);
+            for (int v = 0; v < n; v++){
+                add_node();
+                int last = -1;
+                while (not stack.empty() and priority[stack.back()] < priority[v]){
+                    last = stack.back();
+                    stack.pop_back();
+                    count[last] = v - first[last];
+                }
+                first[v] = stack.empty() ? 0 : stack.back() + 1;
+                left[v] = last;
+                if (last >= 0){
+                    parent[last] = v;
+                }
+                if (not stack.empty()){
+                    right[stack.back()] = v;
+                    parent[v] = stack.back();
+                }
+                stack.push_back(v);
+            }
+            for (int v: stack){
+                count[v] = n - first[v];
+            }
+            root = stack.empty() ? -1 : stack[0];
+        }
+
+        int size(){
+            return size_of(root);
+        }
+
+        int position(int id){
+            int p = size_of(left[id]);
+            for (int v = id; parent[v] >= 0; v = parent[v]){
+                if (right[parent[v]] == v){
+                    p += size_of(left[parent[v]]) + 1;
+                }
+            }
+            return p;
+        }
+
+        int insert(int p){
+            // a new id at position p, moving everything from p on along
+            // by one; returns the id
+            int id = add_node();
+            if (root < 0){
+                root = id;
+                return id;
+            }
+            int v = root;
+            while (true){
+                count[v]++;
+                int before = size_of(left[v]);
+                int &child = p <= before ? left[v] : right[v];
+                if (p > before){
+                    p -= before + 1;
+                }
+                if (child < 0){
+                    child = id;
+                    parent[id] = v;
+                    break;
+                }
+                v = child;
+            }
+            while (parent[id] >= 0 and priority[parent[id]] < priority[id]){
+                rotate_up(id);
+            }
+            return id;
+        }
+};
+
+class ArrayTour {
+    // a route held as a cycle over node ids 0..n-1: 'order' lists the nodes
+    // in tour order and 'pos' is its inverse. node 0 is the opening depot and
+    // n-1 the closing one; the edge joining them is never broken by a move,
+    // so the cycle always reads back as a depot-to-depot route
+    private:
+        vector<int> order, pos;
+
+    public:
+        ArrayTour(int n): order(n), pos(n){
+            for (int v = 0; v < n; v++){
+                order[v] = pos[v] = v;
+            }
+        }
+
+        int size(){
+            return order.size();
+        }
+        int next(int v){
+            int p = pos[v] + 1;
+            return order[p == size() ? 0 : p];
+        }
+        int prev(int v){
+            int p = pos[v];
+            return order[p == 0 ? size() - 1 : p - 1];
+        }
+        bool between(int a, int b, int c){
+            // whether b lies on the forward path from a to c (inclusive)
+            int pa = pos[a], pb = pos[b], pc = pos[c];
+            if (pa <= pc){
+                return pa <= pb and pb <= pc;
+            }
+            return pb >= pa or pb <= pc;
+        }
+        bool sequence(int a, int b, int c){
+            return between(a, b, c);
+        }
+        bool pinned(int a, int b){
+            // the depot-to-depot edge
+            return (a == 0 and b == size() - 1) or (b == 0 and a == size() - 1);
+        }
+
+        void flip(int a, int b, int c, int d){
+            // 2-opt move with b = next(a) and d = next(c): edges (a, b) and
+            // (c, d) become (a, c) and (b, d) by reversing the path b..c, or
+            // its complement d..a when that is shorter
+            int from = pos[b], to = pos[c];
+            int length = to - from;
+            if (length < 0){
+                length += size();
+            }
+            if (2 * (length + 1) > size()){
+                from = pos[d];
+                to = pos[a];
+                length = size() - 2 - length;
+            }
+            for (int step = 0; step < (length + 1) / 2; step++){
+                int u = order[from], v = order[to];
+                order[from] = v; pos[v] = from;
+                order[to] = u; pos[u] = to;
+                from = from + 1 == size() ? 0 : from + 1;
+                to = to == 0 ? size() - 1 : to - 1;
+            }
+        }
+
+        vector<int> path(){
+            // node ids from the opening depot to the closing one
+            vector<int> nodes;
+            bool forward = next(0) != size() - 1;
+            for (int v = 0, k = 0; k < size(); k++){
+                nodes.push_back(v);
+                v = forward ? next(v) : prev(v);
+            }
+            return nodes;
+        }
+};
+
+class TwoLevelTour {
+    // the same cycle as ArrayTour, held as a two-level list: the tour is an
+    // ordered ring of segments of about sqrt(n) nodes, each with a reversal
+    // bit, and every node knows its segment and slot. a flip splits at most
+    // two segments and then reverses the run of whole segments between them
+    // by flipping their bits, so it costs O(sqrt(n)) instead of O(n). the
+    // segments are rebuilt evenly once splits have doubled their number.
+    // flips reverse the same side ArrayTour does, so both give identical tours
+    private:
+        struct Segment {
+            vector<int> nodes;
+            bool reversed;
+            int rank;  // place in 'ring'
+            int start; // tour position of the segment's first node
+        };
+        int n;
+        vector<Segment> segments;
+        vector<int> ring;
+        vector<int> segment_of, slot_of;
+
+        int offset(int v){
+            // place of v within its segment, in tour direction
+            Segment &s = segments[segment_of[v]];
+            return s.reversed ? (int) s.nodes.size() - 1 - slot_of[v] : slot_of[v];
+        }
+        int at(int segment, int k){
+            // node at tour-direction offset k of a segment
+            Segment &s = segments[segment];
+            return s.nodes[s.reversed ? s.nodes.size() - 1 - k : k];
+        }
+        int position(int v){
+            return segments[segment_of[v]].start + offset(v);
+        }
+
+        void renumber(){
+            int start = 0;
+            for (int r = 0; r < (int) ring.size(); r++){
+                segments[ring[r]].rank = r;
+                segments[ring[r]].start = start;
+                start += segments[ring[r]].nodes.size();
             }
-            return result; 
         }
 
-        bool in(Address newaddress){
-            for(Address a: addresses){
-                if(newaddress.distance(a) == 0){
-                    return true;
-                }
-            }
-            return false;
+        void rebuild(vector<int> order){
+            // even segments of about sqrt(n) nodes over a tour order
+            int length = std::max(1, (int) std::sqrt((double) n));
+            segments.clear();
+            ring.clear();
+            for (int first = 0; first < n; first += length){
+                Segment s = {vector<int>(order.begin() + first, order.begin() + std::min(n, first + length)), false, 0, 0};
+                for (int k = 0; k < (int) s.nodes.size(); k++){
+                    segment_of[s.nodes[k]] = segments.size();
+                    slot_of[s.nodes[k]] = k;
+                }
+                ring.push_back(segments.size());
+                segments.push_back(s);
+            }
+            renumber();
+        }
+
+        void split_before(int v){
+            // make v the first node, in tour direction, of its segment; the
+            // nodes before it move to a new segment placed just ahead
+            int k = offset(v);
+            if (k == 0){
+                return;
+            }
+            int old = segment_of[v];
+            Segment head = {{}, segments[old].reversed, 0, 0};
+            vector<int> &nodes = segments[old].nodes;
+            int size = nodes.size();
+            if (head.reversed){
+                head.nodes.assign(nodes.end() - k, nodes.end());
+                nodes.resize(size - k);
+            } else {
+                head.nodes.assign(nodes.begin(), nodes.begin() + k);
+                nodes.erase(nodes.begin(), nodes.begin() + k);
+                for (int slot = 0; slot < (int) nodes.size(); slot++){
+                    slot_of[nodes[slot]] = slot;
+                }
+            }
+            int id = segments.size();
+            for (int slot = 0; slot < (int) head.nodes.size(); slot++){
+                segment_of[head.nodes[slot]] = id;
+                slot_of[head.nodes[slot]] = slot;
+            }
+            ring.insert(ring.begin() + segments[old].rank, id);
+            segments.push_back(head);
+            renumber();
+        }
+
+        void reverse_path(int from, int to){
+            // reverse the forward path from..to, which is not the whole tour
+            int after = next(to);
+            split_before(from);
+            split_before(after);
+            int first = segments[segment_of[from]].rank, last = segments[segment_of[to]].rank;
+            int count = last - first;
+            if (count < 0){
+                count += ring.size();
+            }
+            for (int k = 0; k <= count; k++){
+                segments[ring[(first + k) % ring.size()]].reversed ^= true;
+            }
+            for (int lo = first, hi = last, step = 0; step < (count + 1) / 2; step++){
+                std::swap(ring[lo], ring[hi]);
+                lo = lo + 1 == (int) ring.size() ? 0 : lo + 1;
+                hi = hi == 0 ? ring.size() - 1 : hi - 1;
+            }
+            renumber();
+            if (ring.size() > 2 * std::sqrt((double) n) + 2){
+                rebuild(order());
+            }
+        }
+
+    public:
+        TwoLevelTour(int n): n(n), segment_of(n), slot_of(n){
+            vector<int> order(n);
+            for (int v = 0; v < n; v++){
+                order[v] = v;
+            }
+            rebuild(order);
+        }
+
+        int size(){
+            return n;
+        }
+        int next(int v){
+            int k = offset(v), s = segment_of[v];
+            if (k + 1 < (int) segments[s].nodes.size()){
+                return at(s, k + 1);
+            }
+            int r = segments[s].rank + 1;
+            return at(ring[r == (int) ring.size() ? 0 : r], 0);
+        }
+        int prev(int v){
+            int k = offset(v), s = segment_of[v];
+            if (k > 0){
+                return at(s, k - 1);
+            }
+            int r = segments[s].rank;
+            int before = ring[r == 0 ? ring.size() - 1 : r - 1];
+            return at(before, segments[before].nodes.size() - 1);
+        }
+        bool between(int a, int b, int c){
+            // whether b lies on the forward path from a to c (inclusive)
+            int pa = position(a), pb = position(b), pc = position(c);
+            if (pa <= pc){
+                return pa <= pb and pb <= pc;
+            }
+            return pb >= pa or pb <= pc;
+        }
+        bool sequence(int a, int b, int c){
+            return between(a, b, c);
+        }
+        bool pinned(int a, int b){
+            // the depot-to-depot edge
+            return (a == 0 and b == n - 1) or (b == 0 and a == n - 1);
+        }
+
+        void flip(int a, int b, int c, int d){
+            // 2-opt move with b = next(a) and d = next(c), as ArrayTour::flip
+            int length = position(c) - position(b);
+            if (length < 0){
+                length += n;
+            }
+            if (2 * (length + 1) > n){
+                reverse_path(d, a);
+            } else {
+                reverse_path(b, c);
+            }
+        }
+
+        int segment_count(){
+            return ring.size();
+        }
+
+        vector<int> order(){
+            // every node in tour direction, starting from the first segment
+            vector<int> nodes;
+            for (int s: ring){
+                for (int k = 0; k < (int) segments[s].nodes.size(); k++){
+                    nodes.push_back(at(s, k));
+                }
+            }
+            return nodes;
+        }
+
+        vector<int> path(){
+            // node ids from the opening depot to the closing one
+            vector<int> nodes;
+            bool forward = next(0) != n - 1;
+            for (int v = 0, k = 0; k < n; k++){
+                nodes.push_back(v);
+                v = forward ? next(v) : prev(v);
+            }
+            return nodes;
+        }
+};
+
+vector<vector<int>> neighbour_lists(Coordinates &coords, int k){
+    // the k nearest other points of every point, closest first
+    SpatialGrid grid(coords);
+    vector<vector<int>> lists(coords.size());
+    for (int v = 0; v < coords.size(); v++){
+        for (int u: grid.k_nearest(coords.xs[v], coords.ys[v], k + 1)){
+            if (u != v and (int) lists[v].size() < k){
+                lists[v].push_back(u);
+            }
+        }
+    }
+    return lists;
+}
+
+class LazyNeighbours {
+    // the lists neighbour_lists would give, each computed on first use, so
+    // a search that only visits a few points only pays for those
+    private:
+        SpatialGrid grid;
+        Coordinates &coords;
+        int k;
+        vector<vector<int>> lists;
+        vector<char> done;
+
+    public:
+        LazyNeighbours(Coordinates &coords, int k): grid(coords), coords(coords), k(k),
+            lists(coords.size()), done(coords.size(), 0){}
+
+        vector<int> &operator[](int v){
+            if (not done[v]){
+                done[v] = 1;
+                for (int u: grid.k_nearest(coords.xs[v], coords.ys[v], k + 1)){
+                    if (u != v and (int) lists[v].size() < k){
+                        lists[v].push_back(u);
+                    }
+                }
+            }
+            return lists[v];
+        }
+};
+
+class WorkPool {
+    // a fixed set of worker threads for parallel_for jobs. every worker,
+    // the calling thread included, starts on its own contiguous share of
+    // the tasks and steals from the back of the others' queues once its own
+    // runs dry, which evens out triangular loops. a parallel_for issued from
+    // inside a job runs inline on the calling worker
+    private:
+        struct Queue {
+            std::mutex lock;
+            std::deque<int> tasks;
+        };
+        vector<std::thread> threads;
+        vector<std::unique_ptr<Queue>> queues;
+        std::mutex job_lock;
+        std::condition_variable job_ready, job_done;
+        std::function<void(int, int)> job;
+        std::mutex run_lock;
+        int generation = 0, running = 0;
+        bool stopping = false;
+
+        static bool &inside_job(){
+            static thread_local bool inside = false;
+            return inside;
+        }
+
+        bool take(int worker, int &task){
+            // own queue from the front, then the others' from the back
+            for (int k = 0; k < size(); k++){
+                Queue &q = *queues[(worker + k) % size()];
+                std::lock_guard<std::mutex> guard(q.lock);
+                if (not q.tasks.empty()){
+                    if (k == 0){
+                        task = q.tasks.front();
+                        q.tasks.pop_front();
+                    } else {
+                        task = q.tasks.back();
+                        q.tasks.pop_back();
+                    }
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void work(int worker){
+            inside_job() = true;
+            int task;
+            while (take(worker, task)){
+                job(task, worker);
+            }
+            inside_job() = false;
+        }
+
+        void serve(int worker){
+            int seen = 0;
+            while (true){
+                {
+                    std::unique_lock<std::mutex> guard(job_lock);
+                    job_ready.wait(guard, [&]{ return stopping or generation != seen; });
+                    if (stopping){
+                        return;
+                    }
+                    seen = generation;
+                }
+                work(worker);
+                std::lock_guard<std::mutex> guard(job_lock);
+                if (--running == 0){
+                    job_done.notify_all();
+                }
+            }
+        }
+
+    public:
+        WorkPool(int workers){
+            for (int w = 0; w < std::max(1, workers); w++){
+                queues.emplace_back(new Queue());
+            }
+            for (int w = 1; w < size(); w++){
+                threads.emplace_back(&WorkPool::serve, this, w);
+            }
+        }
+        ~WorkPool(){
+            {
+                std::lock_guard<std::mutex> guard(job_lock);
+                stopping = true;
+            }
+            job_ready.notify_all();
+            for (std::thread &t: threads){
+                t.join();
+            }
+        }
+
+        static WorkPool &shared(int workers){
+            // one long-lived pool per worker count
+            static std::mutex pools_lock;
+            static std::unordered_map<int, std::unique_ptr<WorkPool>> pools;
+            std::lock_guard<std::mutex> guard(pools_lock);
+            std::unique_ptr<WorkPool> &pool = pools[workers];
+            if (not pool){
+                pool.reset(new WorkPool(workers));
+            }
+            return *pool;
+        }
+
+        int size(){
+            return queues.size();
+        }
+
+        void parallel_for(int tasks, std::function<void(int task, int worker)> body){
+            // runs body(task, worker) for every task in [0, tasks); worker is
+            // in [0, size()) and no two running calls share one
+            if (size() == 1 or inside_job()){
+                for (int task = 0; task < tasks; task++){
+                    body(task, 0);
+                }
+                return;
+            }
+            std::lock_guard<std::mutex> one_job(run_lock);
+            for (int w = 0; w < size(); w++){
+                Queue &q = *queues[w];
+                for (int task = (long long) tasks * w / size(); task < (long long) tasks * (w + 1) / size(); task++){
+                    q.tasks.push_back(task);
+                }
+            }
+            {
+                std::lock_guard<std::mutex> guard(job_lock);
+                job = body;
+                running = size() - 1;
+                generation++;
+            }
+            job_ready.notify_all();
+            work(0);
+            std::unique_lock<std::mutex> guard(job_lock);
+            job_done.wait(guard, [&]{ return running == 0; });
+        }
+
+};
+
+template <typename Tour>
+class LinKernighan {
+    // Lin-Kernighan style variable-depth search over a cycle of addresses.
+    // from t1, break edge (t1, t2), link t2 to a nearby t3 and break (t3, t4),
+    // which is one 2-opt flip leaving (t4, t1) as the closing edge; then carry
+    // on from t4 as the new t2. a chain grows while its running gain stays
+    // positive, up to max_depth flips, with breadth[depth] alternatives tried
+    // at the first levels. the best feasible closed prefix is kept and the
+    // rest of the chain is undone
+    private:
+        vector<Address> &nodes;
+        vector<vector<int>> &near;
+        std::function<bool(Tour &)> feasible;
+        int max_depth;
+        vector<int> breadth = {5, 3};
+        vector<std::array<int, 4>> flips;
+        float best_gain;
+        int best_depth;
+
+        float dist(int a, int b){
+            STAT_COUNT(distance_evaluations);
+            return nodes[a].distance(nodes[b]);
+        }
+
+        void undo(){
+            // flip(a, b, c, d) linked (a, c) and (b, d); relink (a, b), (c, d)
+            std::array<int, 4> f = flips.back();
+            flips.pop_back();
+            int a = f[0], b = f[1], c = f[2], d = f[3];
+            if (tour.next(a) == c){
+                tour.flip(a, c, b, d);
+            } else {
+                tour.flip(c, a, d, b);
+            }
+        }
+
+        void step(int t1, int t2, float gain, float tolerance, int depth){
+            bool forward = tour.next(t1) == t2;
+            vector<std::pair<float, int>> choices;
+            for (int t3: near[t2]){
+                float g = gain - dist(t2, t3);
+                if (g <= 0){
+                    break;
+                }
+                int t4 = forward ? tour.prev(t3) : tour.next(t3);
+                if (t3 == t1 or t4 == t2 or tour.pinned(t3, t4)){
+                    continue;
+                }
+                STAT_COUNT(lk_evaluated);
+                choices.push_back({g + dist(t3, t4), t3});
+            }
+            std::sort(choices.begin(), choices.end(), std::greater<std::pair<float, int>>());
+            int tries = depth < (int) breadth.size() ? breadth[depth] : 1;
+            for (int k = 0; k < (int) choices.size() and k < tries; k++){
+                int t3 = choices[k].second;
+                int t4 = forward ? tour.prev(t3) : tour.next(t3);
+                if (forward){
+                    flips.push_back({t1, t2, t4, t3});
+                } else {
+                    flips.push_back({t2, t1, t3, t4});
+                }
+                std::array<int, 4> &f = flips.back();
+                tour.flip(f[0], f[1], f[2], f[3]);
+                float open = choices[k].first;
+                float closed = open - dist(t4, t1);
+                if (closed > best_gain + tolerance and feasible(tour)){
+                    best_gain = closed;
+                    best_depth = flips.size();
+                }
+                if (depth + 1 < max_depth){
+                    step(t1, t4, open, tolerance, depth + 1);
+                }
+                if (best_gain > 0){
+                    return;
+                }
+                undo();
+            }
+        }
+
+    public:
+        Tour tour;
+
+        LinKernighan(vector<Address> &nodes, vector<vector<int>> &near,
+            std::function<bool(Tour &)> feasible, int max_depth):
+            nodes(nodes), near(near), feasible(feasible),
+            max_depth(max_depth), tour(nodes.size()) {}
+
+        bool run(){
+            // improve from every stop, revisiting stops near applied chains
+            // until none improves; returns whether the tour changed
+            vector<int> active;
+            vector<char> queued(tour.size(), 1);
+            for (int v = tour.size() - 1; v >= 0; v--){
+                active.push_back(v);
+            }
+            bool any = false;
+            while (not active.empty()){
+                int t1 = active.back();
+                active.pop_back();
+                queued[t1] = 0;
+                for (int t2: {tour.next(t1), tour.prev(t1)}){
+                    if (tour.pinned(t1, t2)){
+                        continue;
+                    }
+                    flips.clear();
+                    best_gain = 0;
+                    best_depth = 0;
+                    float gain = dist(t1, t2);
+                    step(t1, t2, gain, gain * 1e-5f, 0);
+                    while ((int) flips.size() > best_depth){
+                        undo();
+                    }
+                    if (best_depth > 0){
+                        STAT_COUNT(lk_accepted);
+                        any = true;
+                        for (std::array<int, 4> &f: flips){
+                            for (int v: f){
+                                if (not queued[v]){
+                                    queued[v] = 1;
+                                    active.push_back(v);
+                                }
+                            }
+                        }
+                        if (not queued[t1]){
+                            queued[t1] = 1;
+                            active.push_back(t1);
+                        }
+                        break;
+                    }
+                }
+            }
+            return any;
+        }
+};
+
+bool improves(float removed, float added){
+    // a move only counts if it beats float noise on the edges it removes;
+    // otherwise a move and its inverse can both look improving and loop
+    return removed - added > removed * 1e-5f;
+}
+
+class Deadline {
+    // a wall-clock budget that is cheap to poll: expired() only reads the
+    // clock on every 64th poll, for loops whose steps are a few distance
+    // lookups; expired_now() reads it every time, for steps of O(n) work.
+    // once it has passed, neither reads the clock again. polls may come
+    // from several workers at once
+    private:
+        typedef std::chrono::steady_clock clock;
+        clock::time_point start, end;
+        std::atomic<unsigned> polls{0};
+        std::atomic<bool> passed{false};
+
+    public:
+        Deadline(double seconds): start(clock::now()),
+            end(start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds))){}
+
+        bool expired(){
+            if (passed.load(std::memory_order_relaxed)){
+                return true;
+            }
+            if (polls.fetch_add(1, std::memory_order_relaxed) % 64 != 0){
+                return false;
+            }
+            if (clock::now() >= end){
+                passed.store(true, std::memory_order_relaxed);
+                return true;
+            }
+            return false;
+        }
+        bool expired_now(){
+            if (passed.load(std::memory_order_relaxed)){
+                return true;
+            }
+            if (clock::now() >= end){
+                passed.store(true, std::memory_order_relaxed);
+                return true;
+            }
+            return false;
+        }
+        bool stopped(){
+            // whether a poll has seen the deadline pass
+            return passed.load(std::memory_order_relaxed);
+        }
+        double elapsed(){
+            return std::chrono::duration<double>(clock::now() - start).count();
+        }
+        double budget(){
+            return std::chrono::duration<double>(end - start).count();
+        }
+};
+
+struct AnytimeReport {
+    // where an optimize(deadline) call spent its budget
+    double budget = 0, used = 0;
+    vector<std::pair<string, double>> phases; // seconds, in the order first run
+    int passes = 0;
+    bool converged = false; // reached a local optimum before the deadline
+    float initial_length = 0, final_length = 0;
+
+    bool run(Deadline &limit, const string &phase, std::function<bool()> pass){
+        // runs one improvement pass, charging its time to phase
+        double before = limit.elapsed();
+        bool moved = pass();
+        add(phase, limit.elapsed() - before);
+        return moved;
+    }
+    void add(const string &phase, double seconds){
+        for (auto &entry: phases){
+            if (entry.first == phase){
+                entry.second += seconds;
+                return;
+            }
+        }
+        phases.push_back({phase, seconds});
+    }
+    void print(){
+        for (auto &entry: phases){
+            cout << entry.first << ": " << entry.second << " s (" << 100 * entry.second / budget
+                << "% of budget)" << endl;
+        }
+        cout << passes << " passes in " << used << " of " << budget << " s, "
+            << (converged ? "converged" : "stopped at the deadline") << ", length "
+            << initial_length << " -> " << final_length << endl;
+    }
+};
+
+template <typename Tour, typename Near>
+bool two_opt_search(vector<Address> &nodes, Near &near, vector<int> &path,
+    vector<int> *seeds = nullptr, Deadline *deadline = nullptr){
+    // candidate-list 2-opt with don't-look bits over a tour of 'nodes'; on
+    // improvement, 'path' gets the new depot-to-depot order. 'near[v]' gives
+    // v's candidates. with seeds, only those nodes start with their bit
+    // cleared and the search spreads from them as moves touch other nodes.
+    // past the deadline it stops with the moves made so far
+    auto dist = [&](int a, int b){
+        STAT_COUNT(distance_evaluations);
+        return nodes[a].distance(nodes[b]);
+    };
+    Tour tour(nodes.size());
+    vector<int> active;
+    vector<char> queued(tour.size(), seeds ? 0 : 1);
+    if (seeds){
+        for (auto v = seeds->rbegin(); v != seeds->rend(); v++){
+            if (not queued[*v]){
+                queued[*v] = 1;
+                active.push_back(*v);
+            }
+        }
+    } else {
+        for (int v = tour.size() - 1; v >= 0; v--){
+            active.push_back(v);
+        }
+    }
+    bool any = false;
+    while (not active.empty() and not (deadline and deadline->expired())){
+        int a = active.back();
+        active.pop_back();
+        queued[a] = 0;
+        bool moved = false;
+        for (int direction = 0; direction < 2 and not moved; direction++){
+            int b = direction == 0 ? tour.next(a) : tour.prev(a);
+            if (tour.pinned(a, b)){
+                continue;
+            }
+            float ab = dist(a, b);
+            for (int c: near[a]){
+                float ac = dist(a, c);
+                if (ac >= ab){
+                    break;
+                }
+                int d = direction == 0 ? tour.next(c) : tour.prev(c);
+                if (c == b or d == a or tour.pinned(c, d)){
+                    continue;
+                }
+                STAT_COUNT(opt2_knn_evaluated);
+                float removed = ab + dist(c, d);
+                float added = ac + dist(b, d);
+                if (improves(removed, added)){
+                    STAT_COUNT(opt2_knn_accepted);
+                    if (direction == 0){
+                        tour.flip(a, b, c, d);
+                    } else {
+                        tour.flip(b, a, d, c);
+                    }
+                    for (int v: {a, b, c, d}){
+                        if (not queued[v]){
+                            queued[v] = 1;
+                            active.push_back(v);
+                        }
+                    }
+                    moved = any = true;
+                    break;
+                }
+            }
+        }
+    }
+    if (any){
+        path = tour.path();
+    }
+    return any;
+}
+
+template <typename Tour>
+bool lin_kernighan_search(vector<Address> &nodes, vector<vector<int>> &near,
+    std::function<bool(Tour &)> feasible, int max_depth, vector<int> &path){
+    LinKernighan<Tour> search(nodes, near, feasible, max_depth);
+    if (not search.run()){
+        return false;
+    }
+    path = search.tour.path();
+    return true;
+}
+
+class AddressList {
+    protected:
+        vector<Address> addresses;
+        // above this many stops greedy_route switches from scanning to the grid
+        static const size_t greedy_grid_threshold = 512;
+        // how many times each exact coordinate appears in 'addresses'
+        // (a route holds its depot twice); kept in step by every mutation
+        std::unordered_map<uint64_t, int> members;
+        // prefix[k] is the length of the path through addresses[0..k].
+        // mutations only lower 'stale', the first entry that may be out of
+        // date, and the next length query refreshes from there on
+        vector<float> prefix;
+        size_t stale = 0;
+        // structure-of-arrays copy of the coordinates for the nearest
+        // kernels, kept up to date the same lazy way from packed_stale on
+        Coordinates packed;
+        size_t packed_stale = 0;
+        unsigned long long edits = 0; // bumped by every mutation
+
+        float dist(Address &a, Address &b){
+            STAT_COUNT(distance_evaluations);
+            return a.distance(b);
+        }
+        void track(Address &a){
+            members[a.key()]++;
+        }
+        void untrack(Address &a){
+            auto found = members.find(a.key());
+            if (--found->second == 0){
+                members.erase(found);
+            }
+        }
+        void touched(size_t p){
+            // addresses[p] or the edge into it changed
+            stale = std::min(stale, p);
+            packed_stale = std::min(packed_stale, p);
+            edits++;
+        }
+        Coordinates &packed_coordinates(){
+            size_t n = addresses.size();
+            packed.xs.resize(n);
+            packed.ys.resize(n);
+            for (size_t k = packed_stale; k < n; k++){
+                packed.xs[k] = addresses[k].get_i();
+                packed.ys[k] = addresses[k].get_j();
+            }
+            packed_stale = n;
+            return packed;
+        }
+        void refresh(){
+            // entries before 'stale' stay valid when the list shrinks, so a
+            // tail erase only needs the table cut to size
+            prefix.resize(addresses.size());
+            if (stale >= addresses.size()){
+                return;
+            }
+            STAT_COUNT(length_refreshes);
+            STAT_PHASE(length);
+            prefix[0] = 0;
+            for (size_t k = std::max<size_t>(stale, 1); k < addresses.size(); k++){
+                prefix[k] = prefix[k - 1] + dist(addresses[k - 1], addresses[k]);
+            }
+            stale = addresses.size();
+        }
+        void track_all(){
+            // after a wholesale change: recount members, every prefix stale
+            touched(0);
+            members.clear();
+            for (Address &a: addresses){
+                track(a);
+            }
+        }
+    public:
+        AddressList(){
+            addresses = {};
+        }
+        AddressList(vector<Address> source){
+            addresses = source;
+            track_all();
+        }
+        void clear(){
+            addresses = {};
+            members.clear();
+            touched(0);
+        }
+        void add_address(Address newaddress){
+            // adds address a to vector 'addresses' if and only if 
+            // no address in 'addresses' has the exact same coordinates
+            if (in(newaddress)){ 
+                //cout << "Address not added; identical to current member" << endl;
+                //cout << "For " <<  newaddress.as_string() << endl;
+                return;
+            } 
+            touched(addresses.size());
+            addresses.push_back(newaddress);
+            track(newaddress);
+        }
+        template <typename Range>
+        void add_addresses(Range &&newaddresses){
+            // bulk add_address: one pass, dropping repeats within the batch too
+            touched(addresses.size());
+            for (Address a: newaddresses){
+                if (members.emplace(a.key(), 1).second){
+                    addresses.push_back(a);
+                }
+            }
+        }
+        int size(){
+            return addresses.size();
+        }
+        void print(){
+            for (Address a: addresses){
+                a.print();
+            }
+            cout << endl;
+        }
+        float length(){
+            // returns total length of path if added addresses traversed in
+            // order; O(1) unless the list changed since the last query
+            if (addresses.empty()){
+                return 0;
+            }
+            refresh();
+            return prefix.back();
+        }
+        float length(int from, int to){
+            // length of the path from position from to position to
+            refresh();
+            return prefix[to] - prefix[from];
+        }
+        int index_closest_to(Address a){
+            //Assume a is not represented in the list
+            //ie, no 0 distances allowed
+            return nearest_index(packed_coordinates(), a.get_i(), a.get_j());
+        }
+
+        SpatialGrid spatial_index(){
+            // grid over the current addresses; ids are positions in the list
+            return SpatialGrid(coordinates());
+        }
+
+        Coordinates coordinates(){
+            Coordinates coords;
+            coords.xs.reserve(addresses.size());
+            coords.ys.reserve(addresses.size());
+            for (Address &a: addresses){
+                coords.push_back(a);
+            }
+            return coords;
+        }
+        
+        vector<Address> greedy_route(){
+            STAT_PHASE(greedy_route);
+            vector<Address> result; 
+            Address we_are_here = addresses[0]; // assume depot is first item in address list;
+            // throw the following error otherwise
+            if (we_are_here.distance(Address(0,0)) != 0){
+                throw "First address in address list should be depot (origin)";
+            }
+            result.push_back(we_are_here);
+            addresses.erase(addresses.begin());
+            members.clear(); // the list is consumed below
+            touched(0);
+            if (addresses.size() > greedy_grid_threshold){
+                // large lists: nearest-unvisited queries on a spatial grid,
+                // which picks the same stops as the scan below
+                SpatialGrid grid(coordinates());
+                vector<Address> remaining;
+                remaining.swap(addresses);
+                while(grid.size() > 0){
+                    int closest = grid.nearest(we_are_here.get_i(), we_are_here.get_j());
+                    we_are_here = remaining[closest];
+                    result.push_back(we_are_here);
+                    grid.remove(closest);
+                }
+                return result;
+            }
+            // coordinates are packed once and kept in step with 'addresses'
+            Coordinates coords = coordinates();
+            //iterate through 'addresses', append and erase as we go
+            while(addresses.size() > 0){
+                int closest_address_index = nearest_index(coords, we_are_here.get_i(), we_are_here.get_j());
+                we_are_here = addresses[closest_address_index];
+                result.push_back(we_are_here);
+                addresses.erase(addresses.begin() + closest_address_index);
+                coords.erase(closest_address_index);
+            }
+            return result; 
+        }
+
+        bool in(Address newaddress){
+            return members.count(newaddress.key()) > 0;
+        }
+
+        bool anyin(int start, int end){
+            for(Address &a: addresses){
+                for(int i = start; i <= end; i++){
+                    if(dist(addresses[i], a) == 0){
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        bool anyin_subsection(vector<Address> addresslist, int start, int end){
+            STAT_COUNT(anyin_subsection_calls);
+            STAT_PHASE(anyin_subsection);
+            for(int i = start; i <= end; i++){
+                for(Address &a: addresslist){
+                    if(dist(addresses[i], a) == 0){
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        void insert(Address a, int p){
+            touched(p);
+            addresses.insert(addresses.begin() + p, a);
+            track(a);
+        }
+
+        void erase(int p){
+            touched(p);
+            untrack(addresses[p]);
+            addresses.erase(addresses.begin() + p);
+        }
+
+        void erase(int start, int end){
+            touched(start);
+            for (int i = start; i <= end; i++){
+                untrack(addresses[i]);
+            }
+            addresses.erase(addresses.begin() + start, addresses.begin() + end + 1);
+        }
+
+        Address pick_random(Rng &rng){
+            return addresses[rng(size())];
+        }
+
+        vector<Address> my_addresses(){
+            return addresses;
+        }
+
+};
+
+class Route : public AddressList {
+    private:
+        Address depot = Address(0,0);
+        // above this many stops the tour-based searches flip on a two-level
+        // list instead of a flat array
+        static const int two_level_threshold = 50000;
+        // workers scoring multi_opt2 candidates; 1 keeps it on this thread
+        int threads = 1;
+        // set while an optimize(deadline) call runs; the searches poll it and
+        // stop early, keeping the moves already made
+        Deadline *deadline = nullptr;
+        // edges of the route as it stood after its last settle(), keyed by
+        // the exact coordinates of their ends. a stop with an edge missing
+        // from here was added, lost a neighbour or was moved since then
+        typedef std::pair<uint64_t, uint64_t> Edge;
+        struct EdgeHash {
+            size_t operator()(const Edge &e) const {
+                return std::hash<uint64_t>()(e.first * 0x9e3779b97f4a7c15ULL ^ e.second);
+            }
+        };
+        std::unordered_set<Edge, EdgeHash> settled;
+
+        Edge edge_key(Address &a, Address &b){
+            uint64_t x = a.key(), y = b.key();
+            return x < y ? Edge(x, y) : Edge(y, x);
+        }
+
+        // holds the outgoing segment during swap; kept between calls so its
+        // buffer is reused
+        vector<Address> scratch;
+
+        void hand_over(Route &to, Address &a){
+            // moves a's membership from this route to 'to', passing the hash
+            // node across rather than freeing one and allocating another
+            auto found = members.find(a.key());
+            if (found->second > 1){
+                found->second--;
+                to.track(a);
+                return;
+            }
+            auto node = members.extract(found);
+            auto there = to.members.find(a.key());
+            if (there != to.members.end()){
+                there->second++;
+            } else {
+                to.members.insert(std::move(node));
+            }
+        }
+
+        void resize_block(int start, int length, int new_length){
+            // grows or shrinks the block of length slots at start to
+            // new_length with one block move of the tail; what the block
+            // holds afterwards is left to the caller
+            Address filler = depot;
+            if (new_length > length){
+                addresses.insert(addresses.begin() + start + length, new_length - length, filler);
+            } else if (new_length < length){
+                addresses.erase(addresses.begin() + start + new_length, addresses.begin() + start + length);
+            }
+        }
+
+        bool out_of_time(){
+            // polled once per O(n) stretch of a search
+            return deadline and deadline->expired_now();
+        }
+
+        vector<int> dirty_positions(){
+            vector<int> dirty;
+            for (int p = 0; p < size(); p++){
+                bool before = p > 0 and not settled.count(edge_key(addresses[p - 1], addresses[p]));
+                bool after = p + 1 < size() and not settled.count(edge_key(addresses[p], addresses[p + 1]));
+                if (before or after){
+                    dirty.push_back(p);
+                }
+            }
+            return dirty;
+        }
+        // cheapest-insertion mode for add_address(es), with the number of
+        // neighbours whose edges each new stop considers
+        bool cheapest = false;
+        int insertion_k = 8;
+        // neighbour index for cheapest insertion: a grid over the stops and
+        // the positions of the same ids, both kept up to date by every
+        // insertion made through them. any other edit throws the index
+        // away. it is built on first use, and a copied route starts without
+        // one, so copies in the searches stay cheap
+        struct InsertionIndex {
+            SpatialGrid grid;
+            PositionIndex positions;
+            unsigned long long edits = ~0ULL;
+
+            InsertionIndex(){}
+            InsertionIndex(const InsertionIndex &){}
+            InsertionIndex &operator=(const InsertionIndex &){
+                grid = SpatialGrid();
+                positions = PositionIndex();
+                edits = ~0ULL;
+                return *this;
+            }
+        };
+        InsertionIndex insertion;
+
+        void index_for_insertion(){
+            // O(n), only after an edit other than an indexed insertion
+            if (insertion.edits == edits){
+                return;
+            }
+            insertion.grid = SpatialGrid(coordinates());
+            insertion.positions.build(size());
+            insertion.edits = edits;
+        }
+
+        int cheapest_edge(Address &a){
+            // position a would take, between p - 1 and p, among the edges
+            // next to its insertion_k nearest stops (or just before the
+            // closing depot, if that is cheaper). each neighbour's position
+            // costs O(log n)
+            int last = size() - 1;
+            int best = last;
+            float best_cost = dist(addresses[last - 1], a) + dist(a, addresses[last])
+                - dist(addresses[last - 1], addresses[last]);
+            for (int id: insertion.grid.k_nearest(a.get_i(), a.get_j(), insertion_k)){
+                int q = insertion.positions.position(id);
+                for (int p: {q, q + 1}){
+                    if (p < 1 or p > last){
+                        continue;
+                    }
+                    STAT_COUNT(insertion_evaluated);
+                    float cost = dist(addresses[p - 1], a) + dist(a, addresses[p])
+                        - dist(addresses[p - 1], addresses[p]);
+                    if (cost < best_cost or (cost == best_cost and p < best)){
+                        best = p;
+                        best_cost = cost;
+                    }
+                }
+            }
+            return best;
+        }
+
+    public:
+        Route() : AddressList(){
+            clear();
+        }
+        Route(vector<Address> source) : AddressList(source){}
+
+        void clear(){
+            addresses = {depot, depot};
+            track_all();
+            settled.clear();
+        }
+
+        void set_threads(int count){
+            // workers multi_opt2 spreads its candidates over; moves found
+            // are the same for every count
+            threads = std::max(1, count);
+        }
+
+        void set_deadline(Deadline *limit){
+            // searches started while it is set stop once it expires;
+            // nullptr lifts it
+            deadline = limit;
+        }
+
+        AnytimeReport optimize(Deadline &limit, int k = 8){
+            // anytime improvement within a budget: warm-started 2-opt and
+            // Or-opt alternate while either improves, and segment-insertion
+            // 3-opt runs once both are stuck. every move shortens the route,
+            // so when the deadline cuts a pass short the route is the best
+            // found so far. returns where the budget went
+            AnytimeReport report;
+            report.budget = limit.budget();
+            report.initial_length = length();
+            deadline = &limit;
+            while (not limit.expired()){
+                report.passes++;
+                bool moved = report.run(limit, "opt2_knn", [&]{ return opt2_incremental(k); });
+                moved = report.run(limit, "or_opt", [&]{ return or_opt(); }) or moved;
+                if (not moved and not report.run(limit, "opt3", [&]{ return opt3(); })){
+                    report.converged = not limit.stopped();
+                    break;
+                }
+            }
+            deadline = nullptr;
+            report.used = limit.elapsed();
+            report.final_length = length();
+            return report;
+        }
+
+        AnytimeReport optimize(Route &other_route, vector<Address> fixed_sites, Deadline &limit, int k = 8){
+            // the same for a pair of routes: each pass improves both routes
+            // on their own, then applies cross-exchanges (multi_opt2_knn)
+            // until none is left, until a pass changes nothing or time is up
+            AnytimeReport report;
+            report.budget = limit.budget();
+            report.initial_length = length() + other_route.length();
+            deadline = other_route.deadline = &limit;
+            while (not limit.expired()){
+                report.passes++;
+                bool moved = report.run(limit, "opt2_knn", [&]{
+                    bool mine = opt2_incremental(k);
+                    return other_route.opt2_incremental(k) or mine;
+                });
+                moved = report.run(limit, "or_opt", [&]{
+                    bool mine = or_opt();
+                    return other_route.or_opt() or mine;
+                }) or moved;
+                moved = report.run(limit, "multi_opt2", [&]{
+                    bool any = false;
+                    while (multi_opt2_knn(other_route, fixed_sites, k)){
+                        any = true;
+                    }
+                    return any;
+                }) or moved;
+                if (not moved){
+                    report.converged = not limit.stopped();
+                    break;
+                }
+            }
+            deadline = other_route.deadline = nullptr;
+            report.used = limit.elapsed();
+            report.final_length = length() + other_route.length();
+            return report;
+        }
+
+        void set_cheapest_insertion(bool on, int k = 8){
+            // on: add_address(es) place stops where they lengthen the route
+            // least instead of just before the closing depot. finding the
+            // place costs a k-nearest grid query and O(k log n); the stop
+            // then goes into the vector with an O(n) block move
+            cheapest = on;
+            insertion_k = k;
+        }
+
+        void add_address(Address newaddress){
+            // new stops go just before the closing depot, or at their
+            // cheapest position in cheapest-insertion mode
+            if (in(newaddress)){
+                return;
+            }
+            if (not cheapest){
+                insert(newaddress, size() - 1);
+                return;
+            }
+            STAT_COUNT(insertion_accepted);
+            STAT_PHASE(insertion);
+            index_for_insertion();
+            int p = cheapest_edge(newaddress);
+            insert(newaddress, p);
+            insertion.grid.add(newaddress.get_i(), newaddress.get_j());
+            insertion.positions.insert(p);
+            insertion.edits = edits;
+        }
+
+        template <typename Range>
+        void add_addresses_cheapest(Range &&newaddresses){
+            // batched cheapest insertion: every new stop picks its edge
+            // against the route as it stands, stops picking the same edge are
+            // threaded into it one by one where each costs least, and the
+            // route is rebuilt in a single pass
+            STAT_PHASE(insertion);
+            index_for_insertion();
+            vector<std::pair<int, Address>> placed;
+            for (Address a: newaddresses){
+                if (members.emplace(a.key(), 1).second){
+                    placed.push_back({cheapest_edge(a), a});
+                }
+            }
+            if (placed.empty()){
+                return;
+            }
+            std::stable_sort(placed.begin(), placed.end(),
+                [](const std::pair<int, Address> &x, const std::pair<int, Address> &y){ return x.first < y.first; });
+            touched(placed.front().first);
+            vector<Address> merged;
+            merged.reserve(addresses.size() + placed.size());
+            merged.push_back(addresses[0]);
+            size_t next = 0;
+            vector<Address> chain;
+            for (int q = 1; q < size(); q++){
+                chain = {addresses[q - 1], addresses[q]};
+                for (; next < placed.size() and placed[next].first == q; next++){
+                    Address &a = placed[next].second;
+                    int best = 1;
+                    float best_cost = std::numeric_limits<float>::infinity();
+                    for (size_t c = 1; c < chain.size(); c++){
+                        STAT_COUNT(insertion_evaluated);
+                        float cost = dist(chain[c - 1], a) + dist(a, chain[c]) - dist(chain[c - 1], chain[c]);
+                        if (cost < best_cost){
+                            best = c;
+                            best_cost = cost;
+                        }
+                    }
+                    STAT_COUNT(insertion_accepted);
+                    chain.insert(chain.begin() + best, a);
+                }
+                merged.insert(merged.end(), chain.begin() + 1, chain.end());
+            }
+            addresses.swap(merged);
+        }
+
+        template <typename Range>
+        void add_addresses(Range &&newaddresses){
+            if (cheapest){
+                add_addresses_cheapest(newaddresses);
+                return;
+            }
+            touched(addresses.size() - 1);
+            addresses.pop_back();
+            AddressList :: add_addresses(newaddresses);
+            addresses.push_back(depot);
+        }
+
+        Route greedy_route(){
+            // returns a new route that is greedily optimal
+            // construct subvector of all but last stop (depot)
+            AddressList subvector = AddressList(vector<Address>(addresses.begin(), addresses.end() - 1));
+            // constuct and return greedy search output, including depot at end
+            vector<Address> greedy_output = subvector.greedy_route();
+            greedy_output.push_back(depot);
+            return Route(greedy_output);
+        }
+
+        void reverse(int index1, int index2){
+            // reverses route segment in place
+            touched(index1);
+            vector<Address> temp;
+            for(int i = index2; i >= index1; i--){
+                temp.push_back(addresses[i]);
+            }
+            for(int j = index1; j <= index2; j++){
+                addresses[j] = temp[j - index1];
+            }
+        }
+ 
+        bool opt2(){
+            // loop over subarray not consisting of depots;
+            // cannot reverse depot segments
+            // reversing [m, n] only replaces edges (m-1, m) and (n, n+1) with
+            // (m-1, n) and (m, n+1), so score the move from those four stops
+            // and only touch the route once the move is accepted
+            // returns whether any reversal was applied
+            STAT_PHASE(opt2);
+            bool improved = true, any = false;
+            while (improved){
+                improved = false;
+                for(int n = 1; n < size() - 1; n++){
+                    if (out_of_time()){
+                        return any;
+                    }
+                    for(int m = 1; m < n; m++){
+                        STAT_COUNT(opt2_evaluated);
+                        float removed = dist(addresses[m - 1], addresses[m])
+                            + dist(addresses[n], addresses[n + 1]);
+                        float added = dist(addresses[m - 1], addresses[n])
+                            + dist(addresses[m], addresses[n + 1]);
+                        if (improves(removed, added)){
+                            STAT_COUNT(opt2_accepted);
+                            reverse(m, n);
+                            improved = any = true;
+                        }
+                    }
+                }
+            }
+            return any;
+        }
+
+        bool opt2_knn(int k = 8){
+            // opt2 restricted to candidate lists and driven by don't-look
+            // bits: a stop is only revisited after a move touched one of its
+            // edges, and only moves whose new edge joins a stop to one of its
+            // k nearest neighbours (and is shorter than the edge it replaces)
+            // are scored. returns whether any reversal was applied
+            STAT_PHASE(opt2_knn);
+            Coordinates coords = coordinates();
+            vector<vector<int>> near = neighbour_lists(coords, k);
+            vector<int> path;
+            bool any = size() > two_level_threshold
+                ? two_opt_search<TwoLevelTour>(addresses, near, path, nullptr, deadline)
+                : two_opt_search<ArrayTour>(addresses, near, path, nullptr, deadline);
+            if (any){
+                reorder(path);
+            }
+            return any;
+        }
+
+        void settle(){
+            // take the route as it stands as optimized: opt2_incremental
+            // leaves it alone until stops are added, removed or moved
+            settled.clear();
+            for (int p = 1; p < size(); p++){
+                settled.insert(edge_key(addresses[p - 1], addresses[p]));
+            }
+        }
+
+        int dirty_stops(){
+            // stops with an edge that was not there at the last settle()
+            return dirty_positions().size();
+        }
+
+        bool opt2_incremental(int k = 8){
+            // warm-started opt2_knn: only stops next to a change since the
+            // last settle() start with their don't-look bit cleared, and the
+            // search spreads only as far as moves keep touching new stops.
+            // candidate lists are built on demand for the stops it reaches.
+            // a route that was never settled is searched in full. the route
+            // is settled afterwards. returns whether any reversal was applied
+            STAT_PHASE(opt2_knn);
+            vector<int> dirty = dirty_positions();
+            if (dirty.empty()){
+                return false;
+            }
+            Coordinates coords = coordinates();
+            LazyNeighbours near(coords, k);
+            vector<int> path;
+            bool any = size() > two_level_threshold
+                ? two_opt_search<TwoLevelTour>(addresses, near, path, &dirty, deadline)
+                : two_opt_search<ArrayTour>(addresses, near, path, &dirty, deadline);
+            if (any){
+                reorder(path);
+            }
+            if (not out_of_time()){
+                settle();
+            }
+            return any;
+        }
+
+        void reorder(vector<int> &path){
+            // rewrite the route in the order of a tour's node path
+            touched(0);
+            vector<Address> reordered;
+            reordered.reserve(path.size());
+            for (int v: path){
+                reordered.push_back(addresses[v]);
+            }
+            addresses.swap(reordered);
+        }
+
+        bool lin_kernighan(int k = 8, int max_depth = 10){
+            // LK-style variable-depth search within this route; the depots
+            // stay at both ends. returns whether the route changed
+            STAT_PHASE(lin_kernighan);
+            Coordinates coords = coordinates();
+            vector<vector<int>> near = neighbour_lists(coords, k);
+            auto anything = [](auto &){ return true; };
+            vector<int> path;
+            bool changed = size() > two_level_threshold
+                ? lin_kernighan_search<TwoLevelTour>(addresses, near, anything, max_depth, path)
+                : lin_kernighan_search<ArrayTour>(addresses, near, anything, max_depth, path);
+            if (changed){
+                reorder(path);
+            }
+            return changed;
+        }
+
+        bool lin_kernighan(Route &other_route, vector<Address> fixed_sites, int k = 8, int max_depth = 10){
+            // LK-style search over both routes at once, as one cycle: this
+            // route's stops, its closing depot, the other route's stops and
+            // the other closing depot. the middle depot is free to move, and
+            // the routes are read back by splitting the cycle at it. a chain
+            // is only kept if every fixed stop stays on the route it started on
+            STAT_PHASE(lin_kernighan);
+            int my_size = size();
+            vector<Address> nodes(addresses.begin(), addresses.end());
+            nodes.insert(nodes.end(), other_route.addresses.begin() + 1, other_route.addresses.end());
+            int middle = my_size - 1, end = nodes.size() - 1;
+            std::unordered_set<uint64_t> fixed;
+            for (Address &a: fixed_sites){
+                fixed.insert(a.key());
+            }
+            vector<int> mine, theirs;
+            for (int v = 1; v < end; v++){
+                if (v != middle and fixed.count(nodes[v].key())){
+                    (v < middle ? mine : theirs).push_back(v);
+                }
+            }
+            auto feasible = [&](auto &tour){
+                // on the path leaving the opening depot, 'mine' must come
+                // before the middle depot and 'theirs' after it
+                bool forward = tour.next(0) != end;
+                for (int v: mine){
+                    if (forward ? not tour.between(0, v, middle) : not tour.between(middle, v, 0)){
+                        return false;
+                    }
+                }
+                for (int v: theirs){
+                    if (forward ? tour.between(0, v, middle) : tour.between(middle, v, 0)){
+                        return false;
+                    }
+                }
+                return true;
+            };
+            Coordinates coords;
+            for (Address &a: nodes){
+                coords.push_back(a);
+            }
+            vector<vector<int>> near = neighbour_lists(coords, k);
+            vector<int> path;
+            bool changed = (int) nodes.size() > two_level_threshold
+                ? lin_kernighan_search<TwoLevelTour>(nodes, near, feasible, max_depth, path)
+                : lin_kernighan_search<ArrayTour>(nodes, near, feasible, max_depth, path);
+            if (not changed){
+                return false;
+            }
+            vector<Address> mine_now, theirs_now = {depot};
+            bool split = false;
+            for (int v: path){
+                (split ? theirs_now : mine_now).push_back(nodes[v]);
+                split = split or v == middle;
+            }
+            addresses.swap(mine_now);
+            other_route.addresses.swap(theirs_now);
+            track_all();
+            other_route.track_all();
+            return true;
+        }
+
+        bool move_segments(int max_length){
+            // segment insertion: take [s, e] out of the route and put it back
+            // between p and p + 1, facing either way. the move swaps edges
+            // (s-1, s), (e, e+1), (p, p+1) for (s-1, e+1) plus the two edges
+            // joining the segment to p and p + 1, so it is scored in O(1)
+            // returns whether any segment was moved
+            STAT_PHASE(move_segments);
+            bool improved = true, any = false;
+            while (improved){
+                improved = false;
+                for (int length = 1; length <= max_length; length++){
+                    for (int s = 1; s + length - 1 < size() - 1; s++){
+                        if (out_of_time()){
+                            return any;
+                        }
+                        int e = s + length - 1;
+                        for (int p = 0; p < size() - 1; p++){
+                            if (p >= s - 1 and p <= e){
+                                continue;
+                            }
+                            STAT_COUNT(segment_evaluated);
+                            float removed = dist(addresses[s - 1], addresses[s])
+                                + dist(addresses[e], addresses[e + 1]) + dist(addresses[p], addresses[p + 1]);
+                            float closed = dist(addresses[s - 1], addresses[e + 1]);
+                            float forward = closed + dist(addresses[p], addresses[s]) + dist(addresses[e], addresses[p + 1]);
+                            float backward = closed + dist(addresses[p], addresses[e]) + dist(addresses[s], addresses[p + 1]);
+                            if (improves(removed, std::min(forward, backward))){
+                                STAT_COUNT(segment_accepted);
+                                insert_segment(s, e, p, backward < forward);
+                                improved = any = true;
+                            }
+                        }
+                    }
+                }
+            }
+            return any;
+        }
+
+        void insert_segment(int s, int e, int p, bool reversed){
+            // moves [s, e] to sit between positions p and p + 1 (p outside
+            // [s - 1, e]) as block rotations, optionally reversing it
+            touched(std::min(s, p + 1));
+            auto begin = addresses.begin();
+            int first;
+            if (p > e){
+                std::rotate(begin + s, begin + e + 1, begin + p + 1);
+                first = p - (e - s);
+            } else {
+                std::rotate(begin + p + 1, begin + s, begin + e + 1);
+                first = p + 1;
+            }
+            if (reversed){
+                std::reverse(begin + first, begin + first + e - s + 1);
+            }
+        }
+
+        bool or_opt(){
+            // Or-opt: move chains of 1 to 3 stops
+            return move_segments(3);
+        }
+
+        bool opt3(){
+            // segment-insertion 3-opt: move chains of any length
+            return move_segments(size() - 2);
+        }
+
+        bool vnd(){
+            // variable neighbourhood descent over opt2, or_opt and opt3:
+            // fall through to the next, costlier neighbourhood only when the
+            // cheaper ones are stuck, and restart from opt2 after any move
+            bool any = false;
+            while (true){
+                if (opt2()){
+                    any = true;
+                }
+                if (or_opt() or opt3()){
+                    any = true;
+                    continue;
+                }
+                return any;
+            }
+        }
+
+        struct Exchange {
+            // segment [my_start, my_end] of this route trades places with
+            // [other_start, other_end] of the other route; reverse_me flips
+            // this route's segment as it lands in the other route and
+            // reverse_other flips the other segment as it lands here
+            int my_start, other_start, my_end, other_end;
+            bool reverse_me, reverse_other;
+            float gain;
+        };
+
+        void consider_exchange(Route &other_route, int m, int j, int n, int i, Exchange &best){
+            // segment interiors keep their length whichever way they face,
+            // so every variant is scored from the boundary edges alone
+            STAT_COUNT(exchange_evaluated);
+            Address &before_me = addresses[m - 1], &after_me = addresses[n + 1];
+            Address &before_other = other_route.addresses[j - 1], &after_other = other_route.addresses[i + 1];
+            float removed = dist(before_me, addresses[m]) + dist(addresses[n], after_me)
+                + dist(before_other, other_route.addresses[j]) + dist(other_route.addresses[i], after_other);
+            for (int variant = 0; variant < 4; variant++){
+                bool reverse_me = variant & 1, reverse_other = variant & 2;
+                // pure swap, swap reverse 1, swap reverse 2, swap reverse both
+                Address &in_first = reverse_other ? other_route.addresses[i] : other_route.addresses[j];
+                Address &in_last = reverse_other ? other_route.addresses[j] : other_route.addresses[i];
+                Address &out_first = reverse_me ? addresses[n] : addresses[m];
+                Address &out_last = reverse_me ? addresses[m] : addresses[n];
+                float added = dist(before_me, in_first) + dist(in_last, after_me)
+                    + dist(before_other, out_first) + dist(out_last, after_other);
+                if (improves(removed, added) and removed - added > best.gain){
+                    best = {m, j, n, i, reverse_me, reverse_other, removed - added};
+                }
+            }
+        }
+
+        void apply_exchange(Route &other_route, Exchange &move){
+            STAT_COUNT(exchange_accepted);
+            swap(other_route, move.my_start, move.other_start, move.my_end, move.other_end,
+                move.reverse_me, move.reverse_other);
+        }
+
+        vector<int> last_fixed(std::unordered_set<uint64_t> &fixed){
+            // for each position, the latest position at or before it holding
+            // a fixed stop, or -1 if there is none
+            vector<int> latest(addresses.size());
+            int last = -1;
+            for (int k = 0; k < size(); k++){
+                if (fixed.count(addresses[k].key())){
+                    last = k;
+                }
+                latest[k] = last;
+            }
+            return latest;
+        }
+
+        void exchange_row(Route &other_route, int n, vector<int> &my_last_fixed,
+            vector<int> &other_last_fixed, Exchange &best){
+            // every exchange whose segment of this route ends at n, in
+            // serial order. [m, n] holds a fixed stop exactly when
+            // last_fixed[n] >= m, so for each n (or i) the feasible starts
+            // are one contiguous range and the rest is never visited
+            for (int m = std::max(1, my_last_fixed[n] + 1); m < n; m++){
+                //iterate over all subsets of other route not containing endpoints
+                for (int i = 1; i < other_route.size() - 1; i++){
+                    for (int j = std::max(1, other_last_fixed[i] + 1); j < i; j++){
+                        consider_exchange(other_route, m, j, n, i, best);
+                    }
+                }
+            }
+        }
+
+        Exchange best_exchange(Route &other_route, vector<int> &my_last_fixed, vector<int> &other_last_fixed){
+            // the serial scan keeps the first of the largest gains. in
+            // parallel every row n is a task and each worker keeps the best
+            // of its rows, breaking gain ties towards the lower n, so the
+            // reduction lands on the same move however rows were stolen
+            Exchange none = {-1, -1, -1, -1, false, false, 0};
+            if (threads <= 1){
+                Exchange best = none;
+                for (int n = 1; n < size() - 1 and not out_of_time(); n++){
+                    exchange_row(other_route, n, my_last_fixed, other_last_fixed, best);
+                }
+                return best;
+            }
+            auto earlier_best = [](Exchange &a, Exchange &b){
+                return a.my_start > 0 and (b.my_start < 0 or a.gain > b.gain
+                    or (a.gain == b.gain and a.my_end < b.my_end));
+            };
+            WorkPool &pool = WorkPool::shared(threads);
+            vector<Exchange> worker_best(pool.size(), none);
+            pool.parallel_for(std::max(0, size() - 2), [&](int task, int worker){
+                if (out_of_time()){
+                    return;
+                }
+                Exchange row_best = none;
+                exchange_row(other_route, task + 1, my_last_fixed, other_last_fixed, row_best);
+                if (earlier_best(row_best, worker_best[worker])){
+                    worker_best[worker] = row_best;
+                }
+            });
+            Exchange best = none;
+            for (Exchange &candidate: worker_best){
+                if (earlier_best(candidate, best)){
+                    best = candidate;
+                }
+            }
+            return best;
+        }
+
+        bool multi_opt2(Route &other_route){
+            // assume only 2 routes optimizing for (mention pairwise+ search in writeup?)
+            // minimization criteria will be total length of routes
+            // the nested loops extend op2 by considering 4 possible routes:
+            // pure swap (..., i, ..., j, ...) (..., m, ..., n...)
+            // swap, reverse 1 (..., j, ..., i, ...) (..., m, ..., n...)
+            // swap, reverse 2 (..., i, ..., j, ...) (..., n, ..., m...)
+            // swap, reverse both (..., i, ..., j, ...) (..., m, ..., n...)
+            // iterate over all subsets of the route not containing endpoints
+            // candidates are scored by consider_exchange without moving
+            // anything; only the best one is applied at the end
+            // returns whether a move was applied
+            STAT_PHASE(multi_opt2);
+            vector<int> my_unfixed(addresses.size(), -1), other_unfixed(other_route.addresses.size(), -1);
+            Exchange best = best_exchange(other_route, my_unfixed, other_unfixed);
+            if (best.my_start > 0){
+                apply_exchange(other_route, best);
+            }
+            return best.my_start > 0;
+        }
+
+        bool multi_opt2(Route &other_route, vector<Address> fixed_sites){
+            // assume only 2 routes optimizing for (mention pairwise+ search in writeup?)
+            // minimization criteria will be total length of routes
+            // same search as above, skipping segments that hold a fixed site,
+            // which are marked once per call
+            STAT_PHASE(multi_opt2);
+            std::unordered_set<uint64_t> fixed;
+            for (Address &a: fixed_sites){
+                fixed.insert(a.key());
+            }
+            vector<int> my_last_fixed = last_fixed(fixed);
+            vector<int> other_last_fixed = other_route.last_fixed(fixed);
+            Exchange best = best_exchange(other_route, my_last_fixed, other_last_fixed);
+            if (best.my_start > 0){
+                apply_exchange(other_route, best);
+            }
+            return best.my_start > 0;
+        }
+
+        bool multi_opt2_knn(Route &other_route, int k = 8, int max_segment = 16){
+            vector<Address> no_fixed_sites;
+            return multi_opt2_knn(other_route, no_fixed_sites, k, max_segment);
+        }
+
+        bool multi_opt2_knn(Route &other_route, vector<Address> fixed_sites, int k = 8, int max_segment = 16){
+            // multi_opt2 restricted to candidate lists: the edge into the
+            // incoming segment from m - 1 and the edge out of it to n + 1 must
+            // each join a stop to one of its k nearest neighbours across both
+            // routes, and both segments hold at most max_segment stops. each
+            // m then offers k ends of the other segment, each n after it k
+            // more, so a call scores O(n k^2 max_segment) quadruples instead
+            // of O(n^4)
+            STAT_PHASE(multi_opt2);
+            std::unordered_set<uint64_t> fixed;
+            for (Address &a: fixed_sites){
+                fixed.insert(a.key());
+            }
+            vector<int> my_last_fixed = last_fixed(fixed);
+            vector<int> other_last_fixed = other_route.last_fixed(fixed);
+            int my_size = size(), other_size = other_route.size();
+            Coordinates coords = coordinates();
+            for (Address &a: other_route.addresses){
+                coords.push_back(a);
+            }
+            vector<vector<int>> near = neighbour_lists(coords, k);
+            // across[p]: the neighbours of position p of this route that are
+            // inner stops of the other route, as positions there
+            vector<vector<int>> across(my_size);
+            for (int p = 0; p < my_size; p++){
+                for (int c: near[p]){
+                    if (c > my_size and c < my_size + other_size - 1){
+                        across[p].push_back(c - my_size);
+                    }
+                }
+            }
+            Exchange best = {-1, -1, -1, -1, false, false, 0};
+            for (int m = 1; m < my_size - 1 and not out_of_time(); m++){
+                for (int n = m + 1; n < my_size - 1 and n - m < max_segment; n++){
+                    if (my_last_fixed[n] >= m){
+                        break;
+                    }
+                    for (int q: across[m - 1]){
+                        for (int r: across[n + 1]){
+                            // q and r bound the other segment, in either order
+                            int j = std::min(q, r), i = std::max(q, r);
+                            if (j < i and i - j < max_segment and other_last_fixed[i] < j){
+                                consider_exchange(other_route, m, j, n, i, best);
+                            }
+                        }
+                    }
+                }
+            }
+            if (best.my_start > 0){
+                apply_exchange(other_route, best);
+            }
+            return best.my_start > 0;
+        }
+
+        bool holds_fixed(std::unordered_set<uint64_t> &fixed, int start, int end){
+            for (int p = start; p <= end; p++){
+                if (fixed.count(addresses[p].key())){
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        float anneal(Route &other_route, std::unordered_set<uint64_t> &fixed, Rng &rng,
+            float temperature, int steps, int max_segment = 3){
+            // Metropolis search at a fixed temperature over random moves:
+            // a 2-opt reversal within either route, or an exchange of
+            // segments of up to max_segment stops, facing either way, that
+            // leaves every fixed stop on its route. every move is scored
+            // from its boundary edges and kept if it shortens the routes or
+            // with probability exp(-growth / temperature) otherwise.
+            // returns the change in total length
+            STAT_PHASE(anneal);
+            float change = 0;
+            auto accept = [&](float delta){
+                STAT_COUNT(anneal_evaluated);
+                if (delta <= 0 or (temperature > 0 and rng.uniform() < exp(-delta / temperature))){
+                    STAT_COUNT(anneal_accepted);
+                    change += delta;
+                    return true;
+                }
+                return false;
+            };
+            for (int step = 0; step < steps and not (deadline and deadline->expired()); step++){
+                int kind = rng(3);
+                if (kind < 2){
+                    Route &route = kind == 0 ? *this : other_route;
+                    vector<Address> &stops = route.addresses;
+                    int inner = route.size() - 2;
+                    if (inner < 2){
+                        continue;
+                    }
+                    int m = 1 + rng(inner), n = 1 + rng(inner);
+                    if (m > n){
+                        std::swap(m, n);
+                    }
+                    if (m == n){
+                        continue;
+                    }
+                    float removed = dist(stops[m - 1], stops[m]) + dist(stops[n], stops[n + 1]);
+                    float added = dist(stops[m - 1], stops[n]) + dist(stops[m], stops[n + 1]);
+                    if (accept(added - removed)){
+                        route.reverse(m, n);
+                    }
+                    continue;
+                }
+                int my_inner = size() - 2, other_inner = other_route.size() - 2;
+                if (my_inner < 1 or other_inner < 1){
+                    continue;
+                }
+                int m = 1 + rng(my_inner), j = 1 + rng(other_inner);
+                int n = std::min(my_inner, m + rng(max_segment)), i = std::min(other_inner, j + rng(max_segment));
+                if (holds_fixed(fixed, m, n) or other_route.holds_fixed(fixed, j, i)){
+                    continue;
+                }
+                bool reverse_me = rng(2), reverse_other = rng(2);
+                vector<Address> &others = other_route.addresses;
+                float removed = dist(addresses[m - 1], addresses[m]) + dist(addresses[n], addresses[n + 1])
+                    + dist(others[j - 1], others[j]) + dist(others[i], others[i + 1]);
+                Address &in_first = reverse_other ? others[i] : others[j];
+                Address &in_last = reverse_other ? others[j] : others[i];
+                Address &out_first = reverse_me ? addresses[n] : addresses[m];
+                Address &out_last = reverse_me ? addresses[m] : addresses[n];
+                float added = dist(addresses[m - 1], in_first) + dist(in_last, addresses[n + 1])
+                    + dist(others[j - 1], out_first) + dist(out_last, others[i + 1]);
+                if (accept(added - removed)){
+                    Exchange move = {m, j, n, i, reverse_me, reverse_other, removed - added};
+                    apply_exchange(other_route, move);
+                }
+            }
+            return change;
+        }
+
+        float try_swap(Route &other_route, int my_start, int other_start, 
+            int my_end, int other_end, bool reverse_me, bool reverse_other) {
+            // test swap, calculates total length from swap, unswap, return length
+            STAT_COUNT(try_swap_calls);
+            STAT_PHASE(try_swap);
+
+            float total_curr_length;
+
+            swap(other_route, my_start, other_start, my_end, other_end, reverse_me, reverse_other);
+            total_curr_length = length() + other_route.length();
+            unswap(other_route, my_start, other_start, my_end, other_end, reverse_me, reverse_other);
+            return total_curr_length;
+
+        }
+        void swap(Route &other_route, int my_start, int other_start, 
+            int my_end, int other_end, bool reverse_me, bool reverse_other) {
+            // [my_start, my_end] moves to the other route, facing the other
+            // way if reverse_me, and [other_start, other_end] comes here,
+            // reversed if reverse_other. done in place: this segment waits
+            // in the scratch arena, each route's gap is resized with a
+            // single block move and the segments are copied in, so once the
+            // vectors have grown to size no call allocates
+            STAT_COUNT(swap_calls);
+            STAT_PHASE(swap);
+            if(my_start == 0 or other_start == 0 or my_end == size() or other_end == other_route.size()){
+                cout << my_start << other_start << my_end << other_end << endl;
+                cout << "aaaaa" << endl;
+                throw "cannot swap links containing depot";
+            }
+            int mine = my_end - my_start + 1, theirs = other_end - other_start + 1;
+            touched(my_start);
+            other_route.touched(other_start);
+            for (int p = my_start; p <= my_end; p++){
+                hand_over(other_route, addresses[p]);
+            }
+            for (int p = other_start; p <= other_end; p++){
+                other_route.hand_over(*this, other_route.addresses[p]);
+            }
+            scratch.assign(addresses.begin() + my_start, addresses.begin() + my_end + 1);
+            resize_block(my_start, mine, theirs);
+            auto incoming = other_route.addresses.begin() + other_start;
+            if (reverse_other){
+                std::reverse_copy(incoming, incoming + theirs, addresses.begin() + my_start);
+            } else {
+                std::copy(incoming, incoming + theirs, addresses.begin() + my_start);
+            }
+            other_route.resize_block(other_start, theirs, mine);
+            auto outgoing = other_route.addresses.begin() + other_start;
+            if (reverse_me){
+                std::reverse_copy(scratch.begin(), scratch.end(), outgoing);
+            } else {
+                std::copy(scratch.begin(), scratch.end(), outgoing);
+            }
+        }
+
+        void unswap(Route &other_route, int my_start, int other_start, 
+            int my_end, int other_end, bool reverse_me, bool reverse_other) {
+            // using the exact same parameters for the original swap, reverse that effect
+            // (the segments go back with the flags crossed, which turns them back round)
+            STAT_COUNT(unswap_calls);
+            int my_diff =  my_end - my_start;
+            int other_diff = other_end - other_start;
+            swap(other_route, my_start, other_start, my_start + other_diff, other_start + my_diff, reverse_other, reverse_me);
+        }
+
+        string as_string(){
+            string output = "";
+            for (Address a: addresses) {
+                output.append(a.as_string());
+            }
+            return output;
+        }
+        
+        
+};
+
+class Fleet {
+    // all routes out of one depot, improved pairwise with the multi_opt2
+    // cross-exchange until no pair of routes has an improving move left
+    private:
+        vector<Route> routes;
+        vector<int> versions; // bumped whenever a route changes
+        int moves_applied = 0;
+
+    public:
+        Fleet(){}
+        Fleet(vector<Route> source): routes(source), versions(source.size(), 0){}
+
+        void add_route(Route route){
+            routes.push_back(std::move(route));
+            versions.push_back(0);
+        }
+        int size(){
+            return routes.size();
+        }
+        Route &route(int k){
+            return routes[k];
+        }
+        int moves(){
+            return moves_applied;
+        }
+        void set_threads(int count){
+            for (Route &r: routes){
+                r.set_threads(count);
+            }
+        }
+        float length(){
+            float total = 0;
+            for (Route &r: routes){
+                total += r.length();
+            }
+            return total;
+        }
+
+        int optimize(vector<Address> fixed_sites = {}, int k = 0){
+            // sweeps every pair of routes, applying one cross-exchange per
+            // pair per sweep, until a whole sweep applies nothing. a pair is
+            // only searched again once one of its routes has changed since
+            // its last fruitless search. k > 0 searches with candidate lists
+            // (multi_opt2_knn) instead of the exhaustive multi_opt2.
+            // returns the number of moves applied by this call
+            int applied = 0;
+            vector<vector<std::pair<int, int>>> stale(size(), vector<std::pair<int, int>>(size(), {-1, -1}));
+            bool improved = true;
+            while (improved){
+                improved = false;
+                for (int a = 0; a < size(); a++){
+                    for (int b = a + 1; b < size(); b++){
+                        std::pair<int, int> now = {versions[a], versions[b]};
+                        if (stale[a][b] == now){
+                            continue;
+                        }
+                        bool moved = k > 0
+                            ? routes[a].multi_opt2_knn(routes[b], fixed_sites, k)
+                            : routes[a].multi_opt2(routes[b], fixed_sites);
+                        if (moved){
+                            versions[a]++;
+                            versions[b]++;
+                            applied++;
+                            improved = true;
+                        } else {
+                            stale[a][b] = now;
+                        }
+                    }
+                }
+            }
+            moves_applied += applied;
+            return applied;
+        }
+
+        AnytimeReport optimize(Deadline &limit, vector<Address> fixed_sites = {}, int k = 8){
+            // optimize within a budget: each pass improves every route on
+            // its own (2-opt, Or-opt), then sweeps the pairs with
+            // multi_opt2_knn, until a pass changes nothing or time is up.
+            // every move shortens the fleet, so it is always the best so far
+            AnytimeReport report;
+            report.budget = limit.budget();
+            report.initial_length = length();
+            for (Route &r: routes){
+                r.set_deadline(&limit);
+            }
+            while (not limit.expired()){
+                report.passes++;
+                bool moved = false;
+                for (int r = 0; r < size(); r++){
+                    bool changed = report.run(limit, "opt2_knn", [&]{ return routes[r].opt2_incremental(k); });
+                    changed = report.run(limit, "or_opt", [&]{ return routes[r].or_opt(); }) or changed;
+                    if (changed){
+                        versions[r]++;
+                        moved = true;
+                    }
+                }
+                moved = report.run(limit, "multi_opt2", [&]{ return optimize(fixed_sites, k) > 0; }) or moved;
+                if (not moved){
+                    report.converged = not limit.stopped();
+                    break;
+                }
+            }
+            for (Route &r: routes){
+                r.set_deadline(nullptr);
+            }
+            report.used = limit.elapsed();
+            report.final_length = length();
+            return report;
+        }
+
+        void report(){
+            for (int k = 0; k < size(); k++){
+                cout << "route " << k << ": " << routes[k].size() - 2 << " stops, length "
+                    << routes[k].length() << endl;
+            }
+            cout << "total length: " << length() << ", inter-route moves applied: "
+                << moves_applied << endl;
+        }
+};
+
+class Tempering {
+    // multi-start search over a pair of routes: every replica holds its own
+    // copy of both routes and its own Rng and runs Route::anneal on a
+    // worker of its own. replicas run in rounds. with exchange on (parallel
+    // tempering) each replica keeps one temperature of a geometric ladder
+    // from hot to cold, and after every round neighbouring rungs trade
+    // routes by the Metropolis rule. with exchange off every replica cools
+    // from hot to cold over the rounds (independent simulated annealing).
+    // the shortest pair any replica held at the end of a round wins. every
+    // random choice comes from the seed, so the outcome does not depend on
+    // the thread count
+    private:
+        struct Replica {
+            Route a, b;
+            Rng rng;
+            float length;
+        };
+        Route &route_a, &route_b;
+        std::unordered_set<uint64_t> fixed;
+        uint64_t seed;
+        int replicas = 0, threads = 0;
+        int rounds = 100, steps = 1000, max_segment = 3;
+        float hot = -1, cold = -1; // in typical edge lengths; -1 for 1 and 0.01
+        bool exchange = true;
+
+    public:
+        Tempering(Route &route_a, Route &route_b, vector<Address> fixed_sites = {}, uint64_t seed = 1):
+            route_a(route_a), route_b(route_b), seed(seed){
+            for (Address &a: fixed_sites){
+                fixed.insert(a.key());
+            }
+        }
+
+        void set_replicas(int count){
+            // 0 for one per worker
+            replicas = count;
+        }
+        void set_threads(int count){
+            // 0 for one per core
+            threads = count;
+        }
+        void set_schedule(int round_count, int steps_per_round, int longest_segment = 3){
+            rounds = round_count;
+            steps = steps_per_round;
+            max_segment = longest_segment;
+        }
+        void set_temperatures(float hottest, float coldest){
+            // in units of a typical edge of a good tour, sqrt(box area / stops)
+            hot = hottest;
+            cold = coldest;
+        }
+        void set_exchange(bool on){
+            exchange = on;
+        }
+
+        float run(){
+            // leaves the best pair found in the routes given to the
+            // constructor and returns its total length
+            int workers = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+            WorkPool &pool = WorkPool::shared(workers);
+            int count = replicas > 0 ? replicas : pool.size();
+            float start = route_a.length() + route_b.length();
+            // typical edge of a good tour: the side of the box each stop gets
+            float x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+            for (Route *route: {&route_a, &route_b}){
+                for (Address &a: route->my_addresses()){
+                    x0 = std::min(x0, a.get_i()); x1 = std::max(x1, a.get_i());
+                    y0 = std::min(y0, a.get_j()); y1 = std::max(y1, a.get_j());
+                }
+            }
+            int stops = std::max(1, route_a.size() + route_b.size() - 3);
+            float edge = std::max(std::sqrt((x1 - x0) * (y1 - y0) / stops), 1e-6f);
+            float t_hot = (hot > 0 ? hot : 1.f) * edge, t_cold = (cold > 0 ? cold : 0.01f) * edge;
+            vector<Replica> ladder;
+            for (int r = 0; r < count; r++){
+                ladder.push_back({route_a, route_b, Rng(seed * 0x9e3779b97f4a7c15ULL + r), start});
+            }
+            Rng referee(seed);
+            Route best_a = route_a, best_b = route_b;
+            float best = start;
+            auto rung = [&](int r, int round){
+                // temperature of replica r in this round; rung 0 is the coldest
+                float along = exchange
+                    ? (count > 1 ? (float) (count - 1 - r) / (count - 1) : 0.f)
+                    : (rounds > 1 ? 1.f - (float) round / (rounds - 1) : 0.f);
+                return t_cold * pow(t_hot / t_cold, along);
+            };
+            for (int round = 0; round < rounds; round++){
+                pool.parallel_for(count, [&](int r, int){
+                    Replica &replica = ladder[r];
+                    replica.a.anneal(replica.b, fixed, replica.rng, rung(r, round), steps, max_segment);
+                    // resynchronise with the routes rather than summing deltas
+                    replica.length = replica.a.length() + replica.b.length();
+                });
+                for (int r = 0; r < count; r++){
+                    if (ladder[r].length < best){
+                        best = ladder[r].length;
+                        best_a = ladder[r].a;
+                        best_b = ladder[r].b;
+                    }
+                }
+                for (int r = 0; exchange and r + 1 < count; r++){
+                    // colder rung r against hotter rung r + 1
+                    float t_r = rung(r, round), t_s = rung(r + 1, round);
+                    float gain = (ladder[r].length - ladder[r + 1].length) * (1 / t_r - 1 / t_s);
+                    if (gain >= 0 or referee.uniform() < exp(gain)){
+                        std::swap(ladder[r].a, ladder[r + 1].a);
+                        std::swap(ladder[r].b, ladder[r + 1].b);
+                        std::swap(ladder[r].length, ladder[r + 1].length);
+                    }
+                }
+            }
+            if (best < start){
+                route_a = best_a;
+                route_b = best_b;
+            }
+            return route_a.length() + route_b.length();
+        }
+};
+
+class InstanceFile {
+    // a day's stops, their split into routes and their prime flags in one
+    // compact binary file. loading maps the file read-only and the arrays
+    // are read where they lie, through xs(), ys(), prime_flags() and
+    // route_view(). route() and fleet() build Routes, which own their stops,
+    // so they copy: about 0.3 s for 1M stops against well under 1 ms to map
+    //   header  "RTDAY001", uint32 routes, uint32 0, uint64 stops
+    //   uint64  route_start[routes + 1], route_start[routes] == stops
+    //   float   xs[stops], ys[stops]   in route order
+    //   uint8   prime[stops]
+    // depots are not stored: every route runs from and to (0, 0)
+    private:
+        struct Header {
+            char magic[8];
+            uint32_t routes, unused;
+            uint64_t stops;
+        };
+        char *base = nullptr;
+        size_t bytes = 0;
+        const Header *header;
+        const uint64_t *starts;
+        const float *xs_, *ys_;
+        const uint8_t *primes_;
+
+        static size_t file_bytes(uint64_t routes, uint64_t stops){
+            return sizeof(Header) + (routes + 1) * sizeof(uint64_t) + stops * (2 * sizeof(float) + 1);
+        }
+
+        void locate(char *start){
+            header = (const Header *) start;
+            starts = (const uint64_t *) (start + sizeof(Header));
+            xs_ = (const float *) (starts + header->routes + 1);
+            ys_ = xs_ + header->stops;
+            primes_ = (const uint8_t *) (ys_ + header->stops);
+        }
+
+        static void write_routes(const string &path, vector<Route *> routes, vector<Address> &primes){
+            std::unordered_set<uint64_t> prime;
+            for (Address &a: primes){
+                prime.insert(a.key());
+            }
+            vector<vector<Address>> stops;
+            uint64_t total = 0;
+            for (Route *r: routes){
+                stops.push_back(r->my_addresses());
+                total += stops.back().size() - 2;
+            }
+            size_t size = file_bytes(routes.size(), total);
+            int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0){
+                throw "cannot create instance file";
+            }
+            if (ftruncate(fd, size) != 0){
+                close(fd);
+                throw "cannot size instance file";
+            }
+            void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (mapped == MAP_FAILED){
+                throw "cannot map instance file";
+            }
+            char *start = (char *) mapped;
+            Header fresh = {{'R', 'T', 'D', 'A', 'Y', '0', '0', '1'}, (uint32_t) routes.size(), 0, total};
+            memcpy(start, &fresh, sizeof fresh);
+            uint64_t *route_start = (uint64_t *) (start + sizeof(Header));
+            float *xs = (float *) (route_start + routes.size() + 1);
+            float *ys = xs + total;
+            uint8_t *flags = (uint8_t *) (ys + total);
+            uint64_t at = 0;
+            for (size_t r = 0; r < stops.size(); r++){
+                route_start[r] = at;
+                // skip the depot at either end
+                for (size_t k = 1; k + 1 < stops[r].size(); k++, at++){
+                    xs[at] = stops[r][k].get_i();
+                    ys[at] = stops[r][k].get_j();
+                    flags[at] = prime.count(stops[r][k].key());
+                }
+            }
+            route_start[stops.size()] = at;
+            munmap(mapped, size);
+        }
+
+    public:
+        InstanceFile(const string &path){
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0){
+                throw "cannot open instance file";
+            }
+            struct stat info;
+            if (fstat(fd, &info) != 0 or (size_t) info.st_size < sizeof(Header)){
+                close(fd);
+                throw "instance file too short";
+            }
+            bytes = info.st_size;
+            void *mapped = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (mapped == MAP_FAILED){
+                throw "cannot map instance file";
+            }
+            base = (char *) mapped;
+            header = (const Header *) base;
+            // sizes are checked against the file before any array is read;
+            // 'stops' is bounded first so file_bytes cannot overflow
+            if (memcmp(header->magic, "RTDAY001", 8) != 0 or header->stops > bytes
+                or bytes != file_bytes(header->routes, header->stops)){
+                munmap(base, bytes);
+                throw "not an instance file";
+            }
+            locate(base);
+            bool ordered = starts[0] == 0 and starts[header->routes] == header->stops;
+            for (uint32_t r = 0; ordered and r < header->routes; r++){
+                ordered = starts[r] <= starts[r + 1];
+            }
+            if (not ordered){
+                munmap(base, bytes);
+                throw "corrupt route boundaries in instance file";
+            }
+        }
+        ~InstanceFile(){
+            munmap(base, bytes);
+        }
+        InstanceFile(const InstanceFile &) = delete;
+        InstanceFile &operator=(const InstanceFile &) = delete;
+
+        static void write(const string &path, vector<Route> &routes, vector<Address> primes = {}){
+            vector<Route *> all;
+            for (Route &r: routes){
+                all.push_back(&r);
+            }
+            write_routes(path, all, primes);
+        }
+        static void write(const string &path, Fleet &fleet, vector<Address> primes = {}){
+            vector<Route *> all;
+            for (int k = 0; k < fleet.size(); k++){
+                all.push_back(&fleet.route(k));
+            }
+            write_routes(path, all, primes);
+        }
+
+        int routes(){
+            return header->routes;
+        }
+        long long stops(){
+            return header->stops;
+        }
+        long long route_start(int r){
+            // first stop of route r; route_start(routes()) is stops()
+            if (r < 0 or r > routes()){
+                throw "no such route in instance file";
+            }
+            return starts[r];
+        }
+        long long route_size(int r){
+            return route_start(r + 1) - route_start(r);
+        }
+
+        struct View {
+            // a stretch of the mapped arrays, valid while the file lives
+            const float *xs, *ys;
+            const uint8_t *primes;
+            long long size;
+            Address address(long long k){
+                return Address(xs[k], ys[k]);
+            }
+        };
+        View route_view(int r){
+            // route r's stops in place, with no copy
+            long long first = route_start(r);
+            return {xs_ + first, ys_ + first, primes_ + first, route_size(r)};
+        }
+        // the mapped arrays themselves, valid while this object lives
+        const float *xs(){
+            return xs_;
+        }
+        const float *ys(){
+            return ys_;
+        }
+        const uint8_t *prime_flags(){
+            return primes_;
+        }
+
+        int nearest(float x, float y){
+            // stop closest to (x, y), scanned straight off the mapping
+            return nearest_index(xs_, ys_, stops(), x, y);
+        }
+
+        Route route(int r){
+            // copies route r into a Route; read route_view(r) in place where
+            // a Route is not needed
+            if (r < 0 or r >= routes()){
+                throw "no such route in instance file";
+            }
+            View stops = route_view(r);
+            vector<Address> copied;
+            copied.reserve(stops.size);
+            for (long long k = 0; k < stops.size; k++){
+                copied.push_back(stops.address(k));
+            }
+            Route loaded;
+            loaded.add_addresses(copied);
+            return loaded;
+        }
+        Fleet fleet(){
+            Fleet loaded;
+            for (int r = 0; r < routes(); r++){
+                loaded.add_route(route(r));
+            }
+            return loaded;
+        }
+        vector<Address> primes(){
+            vector<Address> found;
+            for (long long k = 0; k < stops(); k++){
+                if (primes_[k]){
+                    found.push_back(Address(xs_[k], ys_[k]));
+                }
+            }
+            return found;
+        }
+};
+
+class LineReader {
+    // reads a text file a chunk at a time and hands out its lines in place,
+    // NUL-terminated and without the line break, from one reusable buffer
+    private:
+        FILE *file;
+        vector<char> buffer;
+        size_t begin = 0, end = 0;
+        bool done = false;
+
+    public:
+        LineReader(const string &path, size_t chunk = 1 << 20): buffer(chunk + 1){
+            file = fopen(path.c_str(), "rb");
+            if (not file){
+                throw "cannot open instance";
+            }
+        }
+        ~LineReader(){
+            fclose(file);
+        }
+        LineReader(const LineReader &) = delete;
+        LineReader &operator=(const LineReader &) = delete;
+
+        char *next(){
+            // the next line, or nullptr at end of file; valid until the next call
+            while (true){
+                char *start = buffer.data() + begin;
+                char *newline = (char *) memchr(start, '\n', end - begin);
+                if (newline or (done and begin < end)){
+                    char *stop = newline ? newline : buffer.data() + end;
+                    begin = newline ? newline - buffer.data() + 1 : end;
+                    if (stop > start and stop[-1] == '\r'){
+                        stop--;
+                    }
+                    *stop = '\0';
+                    return start;
+                }
+                if (done){
+                    return nullptr;
+                }
+                // keep the partial line, growing the buffer if it fills it
+                memmove(buffer.data(), start, end - begin);
+                end -= begin;
+                begin = 0;
+                if (end + 1 == buffer.size()){
+                    buffer.resize(buffer.size() * 2);
+                }
+                size_t got = fread(buffer.data() + end, 1, buffer.size() - 1 - end, file);
+                end += got;
+                done = got == 0;
+            }
+        }
+};
+
+struct InstanceInfo {
+    string name;
+    long long nodes = 0;
+    float depot_x = 0, depot_y = 0; // subtracted from every coordinate read
+    double optimal = -1;            // best known tour or solution length, -1 if unknown
+
+    double gap(float length){
+        // percent above the best known value; TSPLIB rounds each edge to an
+        // integer and we do not, so a few hundredths either way is noise
+        return optimal > 0 ? 100 * (length - optimal) / optimal : NAN;
+    }
+};
+
+template <typename Visit>
+void scan_instance(const string &path, InstanceInfo &info, long long &declared_depot, Visit visit){
+    // one streaming pass over a TSPLIB or CSV instance: keywords go into
+    // info, the first DEPOT_SECTION entry into declared_depot (-1 if none)
+    // and every node into visit(id, x, y). only a row's first three numbers
+    // are read, and x and y are the last two of those: "id x y" in TSPLIB,
+    // "x,y" or "id,x,y" in CSV, where anything after them is ignored. CSV
+    // rows are numbered from 1 and a header row is skipped
+    LineReader lines(path);
+    bool tsplib = path.size() < 4 or path.compare(path.size() - 4, 4, ".csv") != 0;
+    bool in_coords = false, in_depots = false;
+    long long row = 0;
+    declared_depot = -1;
+    char *line;
+    while ((line = lines.next())){
+        char *p = line;
+        while (*p == ' ' or *p == '\t'){
+            p++;
+        }
+        if (*p == '\0'){
+            continue;
+        }
+        if (tsplib and (*p < '0' or *p > '9') and *p != '-' and *p != '+' and *p != '.'){
+            // a keyword line or a section header
+            in_coords = strncmp(p, "NODE_COORD_SECTION", 18) == 0;
+            in_depots = strncmp(p, "DEPOT_SECTION", 13) == 0;
+            if (strncmp(p, "EOF", 3) == 0){
+                break;
+            }
+            char *colon = strchr(p, ':');
+            if (not colon){
+                continue;
+            }
+            char *value = colon + 1;
+            while (*value == ' ' or *value == '\t'){
+                value++;
+            }
+            if (strncmp(p, "NAME", 4) == 0){
+                info.name = string(value, strcspn(value, " \t"));
+            } else if (strncmp(p, "DIMENSION", 9) == 0){
+                info.nodes = strtoll(value, nullptr, 10);
+            } else if (strncmp(p, "EDGE_WEIGHT_TYPE", 16) == 0
+                and strncmp(value, "EUC_2D", 6) != 0 and strncmp(value, "CEIL_2D", 7) != 0){
+                throw "only EUC_2D and CEIL_2D instances are supported";
+            } else if (strncmp(p, "COMMENT", 7) == 0){
+                for (const char *label: {"ptimal value", "est value"}){
+                    if (const char *found = strstr(value, label)){
+                        found += strlen(label);
+                        while (*found and (*found < '0' or *found > '9')){
+                            found++;
+                        }
+                        info.optimal = strtod(found, nullptr);
+                    }
+                }
+            }
+            continue;
+        }
+        if (tsplib and in_depots){
+            // the section ends at -1; ids may start from 0 or 1
+            long long id = strtoll(p, nullptr, 10);
+            if (id >= 0 and declared_depot < 0){
+                declared_depot = id;
+            }
+            continue;
+        }
+        if (tsplib and not in_coords){
+            continue;
+        }
+        // numbers on the line: "id x y" for TSPLIB
+        double numbers[3];
+        int count = 0;
+        for (char *rest = p; count < 3; ){
+            while (*rest == ' ' or *rest == '\t' or *rest == ','){
+                rest++;
+            }
+            char *after;
+            double value = strtod(rest, &after);
+            if (after == rest){
+                break;
+            }
+            numbers[count++] = value;
+            rest = after;
+        }
+        if (count < 2){
+            continue;
+        }
+        row++;
+        visit(tsplib ? (long long) numbers[0] : row, (float) numbers[count - 2], (float) numbers[count - 1]);
+    }
+    if (not tsplib){
+        info.nodes = row;
+    }
+}
+
+Route read_instance(const string &path, InstanceInfo &info){
+    // streams a TSPLIB (EUC_2D or CEIL_2D, TSP or CVRP) or CSV instance into
+    // one route, shifted so the depot sits at (0, 0) where Route keeps it:
+    // the DEPOT_SECTION node if there is one, otherwise the first node. a
+    // COMMENT naming an "optimal value" or "best value" fills info.optimal.
+    // CVRP demands and capacity are ignored. a Route holds each coordinate
+    // once, so an instance with two nodes in one place (the depot's
+    // included) is refused rather than loaded short
+    info = InstanceInfo();
+    Route route;
+    vector<Address> batch;
+    batch.reserve(4096);
+    long long depot_id = -1, declared_depot, streamed = 0;
+    auto stream = [&](long long id, float x, float y){
+        if (id == depot_id){
+            return;
+        }
+        streamed++;
+        batch.push_back(Address(x - info.depot_x, y - info.depot_y));
+        if (batch.size() == batch.capacity()){
+            route.add_addresses(batch);
+            batch.clear();
+        }
+    };
+    scan_instance(path, info, declared_depot, [&](long long id, float x, float y){
+        if (depot_id < 0){
+            // until told otherwise the first node is the depot
+            depot_id = id;
+            info.depot_x = x;
+            info.depot_y = y;
+        }
+        stream(id, x, y);
+    });
+    route.add_addresses(batch);
+    batch.clear();
+    if (declared_depot >= 0 and declared_depot != depot_id){
+        // the depot came later in the file: find it, then stream again
+        depot_id = declared_depot;
+        scan_instance(path, info, declared_depot, [&](long long id, float x, float y){
+            if (id == depot_id){
+                info.depot_x = x;
+                info.depot_y = y;
+            }
+        });
+        route.clear();
+        streamed = 0;
+        scan_instance(path, info, declared_depot, stream);
+        route.add_addresses(batch);
+    }
+    if (route.size() - 2 != streamed){
+        throw "instance has two nodes at the same coordinates";
+    }
+    return route;
+}
+
+std::unordered_map<string, double> read_optimal_values(const string &path){
+    // "name : value" lines, as in TSPLIB's solutions list, or "name,value"
+    std::unordered_map<string, double> optimal;
+    LineReader lines(path);
+    char *line;
+    while ((line = lines.next())){
+        char *separator = strpbrk(line, ":,");
+        if (not separator){
+            continue;
+        }
+        string name(line, separator - line);
+        name.erase(name.find_last_not_of(" \t") + 1);
+        name.erase(0, name.find_first_not_of(" \t"));
+        char *value = separator + 1;
+        while (*value and (*value < '0' or *value > '9')){
+            value++;
+        }
+        if (not name.empty() and *value){
+            optimal[name] = strtod(value, nullptr);
+        }
+    }
+    return optimal;
+}
+
+class Workload {
+    // synthetic delivery days of any size, handed out in batches so a
+    // million-stop day never has to sit in memory at once. stops lie in
+    // [0, extent) squared with the depot's corner at the origin:
+    //   uniform:   independent uniform coordinates
+    //   clustered: gaussian blobs of spread * extent around cluster
+    //              centres, like towns around a hub
+    //   road_grid: on streets every block units in either direction,
+    //              like house numbers along a city grid
+    // each stop is prime with probability prime_ratio. a seed gives the
+    // same stream of stops whatever the batch sizes
+    public:
+        enum Distribution { uniform, clustered, road_grid };
+
+    private:
+        Distribution kind;
+        long long total, produced = 0;
+        float extent, prime_ratio;
+        float spread = 0.02f, block = 10;
+        vector<Address> centres;
+        Rng rng;
+
+        float clamp(float v){
+            return std::min(std::max(v, 0.f), std::nextafter(extent, 0.f));
+        }
+
+        Address draw(){
+            if (kind == clustered){
+                Address &centre = centres[rng(centres.size())];
+                float dx, dy;
+                rng.normal_pair(dx, dy);
+                return Address(clamp(centre.get_i() + dx * spread * extent),
+                    clamp(centre.get_j() + dy * spread * extent));
+            }
+            float along = rng.uniform() * extent;
+            if (kind == road_grid){
+                int streets = std::max(1, (int) (extent / block));
+                float street = rng(streets) * block;
+                return rng(2) ? Address(street, along) : Address(along, street);
+            }
+            return Address(along, rng.uniform() * extent);
+        }
+
+    public:
+        Workload(Distribution kind, long long stops, uint64_t seed, float extent = 1000,
+            float prime_ratio = 0, int clusters = 16): kind(kind), total(stops),
+            extent(extent), prime_ratio(prime_ratio), rng(seed){
+            for (int c = 0; kind == clustered and c < clusters; c++){
+                float x = rng.uniform() * extent, y = rng.uniform() * extent;
+                centres.push_back(Address(x, y));
+            }
+        }
+
+        void set_spread(float fraction){
+            // cluster standard deviation as a fraction of extent
+            spread = fraction;
+        }
+        void set_block(float length){
+            // street spacing for road_grid
+            block = length;
+        }
+
+        long long remaining(){
+            return total - produced;
+        }
+
+        int next_batch(vector<Address> &stops, vector<Address> &primes, int limit = 1 << 16){
+            // replaces stops with up to limit new stops and primes with the
+            // prime ones among them; returns how many stops came out, 0 once
+            // the day is exhausted
+            stops.clear();
+            primes.clear();
+            int count = std::min<long long>(limit, remaining());
+            for (int k = 0; k < count; k++){
+                Address a = draw();
+                stops.push_back(a);
+                if (rng.uniform() < prime_ratio){
+                    primes.push_back(a);
+                }
+            }
+            produced += count;
+            return count;
+        }
+};
+
+class RunningStats {
+    // Welford's online mean and variance
+    private:
+        long long n = 0;
+        double running_mean = 0, squares = 0;
+    public:
+        void add(double x){
+            n++;
+            double delta = x - running_mean;
+            running_mean += delta / n;
+            squares += delta * (x - running_mean);
+        }
+        long long count(){
+            return n;
+        }
+        double mean(){
+            return running_mean;
+        }
+        double std(){
+            // sample standard deviation, 0 below two samples
+            return n < 2 ? 0 : sqrt(squares / (n - 1));
+        }
+};
+
+RunningStats run_trials(int trials, uint64_t seed, std::function<float(uint64_t)> trial, int threads = 0){
+    // runs trial(seed + t) for t in [0, trials) across threads workers
+    // (0 for one per core) and folds the results in trial order, so a seed
+    // gives the same statistics for any thread count
+    if (threads <= 0){
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    vector<float> results(trials);
+    WorkPool::shared(threads).parallel_for(trials, [&](int t, int){
+        results[t] = trial(seed + t);
+    });
+    RunningStats stats;
+    for (float x: results){
+        stats.add(x);
+    }
+    return stats;
+}
+
+void evaluate(Route route1, Route route2){
+    cout << "route 1: " ;
+    route1.print();
+    //cout << "route 1 length: " << route1.length() << endl;
+    cout << "route 2: " ;
+    route2.print();
+    //cout << "route 2 length: " << route2.length() << endl;
+    cout << "total length : " << route1.length() + route2.length();
+    cout << endl;
+}
+
+void fleet_test(){
+    Rng rng(137);
+    Fleet fleet;
+    vector<Address> fixed;
+    for (int r = 0; r < 4; r++){
+        Route route;
+        for (int k = 0; k < 8; k++){
+            float x = rng(20), y = rng(20);
+            Address a(x, y);
+            route.add_address(a);
+            if (rng(4) == 0){
+                fixed.push_back(a);
+            }
+        }
+        fleet.add_route(route);
+    }
+    float initial = fleet.length();
+    fleet.optimize(fixed);
+    fleet.report();
+    assert( fleet.length() <= initial );
+}
+
+void parallel_multi_opt2_test(){
+    // every thread count applies the same sequence of moves as serial
+    Rng rng(59);
+    Route serial1, serial2;
+    vector<Address> fixed;
+    for (int k = 0; k < 40; k++){
+        float ax = rng(100), ay = rng(100), bx = rng(100), by = rng(100);
+        Address a(ax, ay), b(bx, by);
+        serial1.add_address(a);
+        serial2.add_address(b);
+        if (k % 7 == 0){
+            fixed.push_back(b);
+        }
+    }
+    for (int threads: {2, 5}){
+        Route mine1 = serial1, mine2 = serial2, free1 = serial1, free2 = serial2;
+        Route base1 = serial1, base2 = serial2, base_free1 = serial1, base_free2 = serial2;
+        mine1.set_threads(threads);
+        free1.set_threads(threads);
+        bool moved = true;
+        while (moved){
+            moved = base1.multi_opt2(base2, fixed);
+            bool mine_moved = mine1.multi_opt2(mine2, fixed);
+            assert( mine_moved == moved );
+            assert( mine1.as_string() == base1.as_string() and mine2.as_string() == base2.as_string() );
+        }
+        moved = true;
+        while (moved){
+            moved = base_free1.multi_opt2(base_free2);
+            bool free_moved = free1.multi_opt2(free2);
+            assert( free_moved == moved );
+            assert( free1.as_string() == base_free1.as_string() and free2.as_string() == base_free2.as_string() );
+        }
+    }
+}
+
+void workload_test(){
+    // the stream depends on the seed alone, not on how it is batched
+    vector<Address> whole, whole_primes, part, part_primes, batch, primes;
+    Workload one(Workload::clustered, 5000, 11, 1000, 0.25);
+    one.next_batch(whole, whole_primes, 5000);
+    Workload many(Workload::clustered, 5000, 11, 1000, 0.25);
+    while (many.next_batch(batch, primes, 777)){
+        part.insert(part.end(), batch.begin(), batch.end());
+        part_primes.insert(part_primes.end(), primes.begin(), primes.end());
+    }
+    assert( many.remaining() == 0 and part.size() == 5000 );
+    for (int k = 0; k < 5000; k++){
+        assert( part[k].key() == whole[k].key() );
+    }
+    assert( part_primes.size() == whole_primes.size() );
+    assert( whole_primes.size() > 1000 and whole_primes.size() < 1500 );
+
+    for (Workload::Distribution kind: {Workload::uniform, Workload::clustered, Workload::road_grid}){
+        Workload day(kind, 20000, 3, 500);
+        AddressList stops;
+        while (day.next_batch(batch, primes, 4096)){
+            for (Address &a: batch){
+                assert( a.get_i() >= 0 and a.get_i() < 500 and a.get_j() >= 0 and a.get_j() < 500 );
+            }
+            stops.add_addresses(batch);
+            assert( primes.empty() );
+        }
+        // continuous coordinates, so hardly anything is rejected as a duplicate
+        assert( stops.size() > 19900 );
+    }
+}
+
+void workload_profile(Workload::Distribution kind, long long stops, uint64_t seed){
+    // streams a day into two routes, then times the route builders and
+    // searches on it. each exchange search between the routes is near
+    // linear with candidate lists, but it applies one move per call and a
+    // day needs about as many calls as it has stops, so it only runs on
+    // days of up to 4000 stops
+    typedef std::chrono::steady_clock clock;
+    auto seconds_since = [](clock::time_point start){
+        return std::chrono::duration<double>(clock::now() - start).count();
+    };
+    Workload day(kind, stops, seed, 1000, 0.1);
+    Route route_a, route_b;
+    vector<Address> batch, primes, fixed;
+    clock::time_point start = clock::now();
+    for (int b = 0; day.next_batch(batch, primes); b++){
+        (b % 2 ? route_b : route_a).add_addresses(batch);
+        fixed.insert(fixed.end(), primes.begin(), primes.end());
+    }
+    cout << "load " << route_a.size() + route_b.size() - 4 << " stops: " << seconds_since(start) << " s" << endl;
+    start = clock::now();
+    route_a = route_a.greedy_route();
+    route_b = route_b.greedy_route();
+    cout << "greedy_route: " << seconds_since(start) << " s, length " << route_a.length() + route_b.length() << endl;
+    start = clock::now();
+    route_a.opt2_knn();
+    route_b.opt2_knn();
+    cout << "opt2_knn: " << seconds_since(start) << " s, length " << route_a.length() + route_b.length() << endl;
+    if (stops <= 4000){
+        start = clock::now();
+        while (route_a.multi_opt2_knn(route_b, fixed)){}
+        cout << "multi_opt2_knn: " << seconds_since(start) << " s, length " << route_a.length() + route_b.length() << endl;
+    }
+}
+
+struct BenchCase {
+    string name;
+    int n, runs;
+    double median, p95; // seconds
+};
+
+BenchCase time_case(string name, int n, int warmup, int runs, std::function<void()> setup,
+    std::function<void()> body){
+    // runs setup and then body warmup + runs times, timing only body and
+    // keeping only the runs after the warm-up. percentiles are nearest-rank
+    typedef std::chrono::steady_clock clock;
+    vector<double> times;
+    for (int r = 0; r < warmup + runs; r++){
+        setup();
+        clock::time_point start = clock::now();
+        body();
+        double took = std::chrono::duration<double>(clock::now() - start).count();
+        if (r >= warmup){
+            times.push_back(took);
+        }
+    }
+    std::sort(times.begin(), times.end());
+    auto rank = [&](double q){
+        return times[std::max(0, std::min(runs - 1, (int) ceil(q * runs) - 1))];
+    };
+    return {name, n, runs, rank(0.5), rank(0.95)};
+}
+
+vector<BenchCase> run_benchmarks(int max_n, uint64_t seed = 1){
+    // times the route builders and searches on uniform days of n = 10, 100,
+    // ... up to max_n stops, each drawn from seed + n. opt2 is quadratic per
+    // sweep and multi_opt2 quartic per call, so they stop at 1000 and 100
+    vector<BenchCase> results;
+    for (int n = 10; n <= max_n; n *= 10){
+        int warmup = n <= 1000 ? 2 : 1, runs = n <= 1000 ? 15 : 5;
+        Workload day(Workload::uniform, n, seed + n, 1000, 0.1);
+        vector<Address> stops, primes;
+        day.next_batch(stops, primes, n);
+        Route base, half_a, half_b, work, other;
+        base.add_addresses(stops);
+        for (int k = 0; k < n; k++){
+            (k % 2 ? half_b : half_a).add_address(stops[k]);
+        }
+        auto from_base = [&]{ work = base; };
+        results.push_back(time_case("greedy_route", n, warmup, runs, from_base,
+            [&]{ work = work.greedy_route(); }));
+        results.push_back(time_case("add_address", n, warmup, runs, [&]{ work = Route(); },
+            [&]{ for (Address &a: stops){ work.add_address(a); } }));
+        results.push_back(time_case("add_address_cheapest", n, warmup, runs,
+            [&]{ work = Route(); work.set_cheapest_insertion(true); },
+            [&]{ for (Address &a: stops){ work.add_address(a); } }));
+        if (n <= 1000){
+            results.push_back(time_case("opt2", n, warmup, runs, from_base, [&]{ work.opt2(); }));
+        }
+        results.push_back(time_case("opt2_knn", n, warmup, runs, from_base, [&]{ work.opt2_knn(); }));
+        if (n <= 100){
+            auto from_halves = [&]{ work = half_a; other = half_b; };
+            results.push_back(time_case("multi_opt2", n, warmup, runs, from_halves,
+                [&]{ work.multi_opt2(other); }));
+            results.push_back(time_case("multi_opt2_fixed", n, warmup, runs, from_halves,
+                [&]{ work.multi_opt2(other, primes); }));
+        }
+    }
+    return results;
+}
+
+void write_benchmarks(vector<BenchCase> &results, const string &path){
+    // one JSON object per case, so runs from two builds diff line by line
+    FILE *out = fopen(path.c_str(), "w");
+    if (not out){
+        throw "cannot write benchmark results";
+    }
+    fprintf(out, "[\n");
+    for (size_t k = 0; k < results.size(); k++){
+        BenchCase &c = results[k];
+        fprintf(out, "  {\"name\": \"%s\", \"n\": %d, \"runs\": %d, \"median_s\": %.9f, \"p95_s\": %.9f}%s\n",
+            c.name.c_str(), c.n, c.runs, c.median, c.p95, k + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "]\n");
+    fclose(out);
+}
+
+void benchmark_test(){
+    // every case is reported once per size it runs at, in order
+    vector<BenchCase> results = run_benchmarks(100);
+    assert( results.size() == 7 + 7 );
+    for (BenchCase &c: results){
+        assert( c.runs == 15 and c.median >= 0 and c.median <= c.p95 );
+    }
+    assert( results[0].name == "greedy_route" and results[0].n == 10 );
+    assert( results.back().name == "multi_opt2_fixed" and results.back().n == 100 );
+    string path = "/tmp/ispfinalproj-bench.json";
+    write_benchmarks(results, path);
+    LineReader lines(path);
+    int objects = 0;
+    for (char *line; (line = lines.next());){
+        objects += strstr(line, "\"median_s\"") != NULL;
+    }
+    assert( objects == 14 );
+    remove(path.c_str());
+}
+
+void instance_file_test(){
+    // a written day maps back to the same routes, primes and lengths
+    Workload day(Workload::road_grid, 3000, 5, 400, 0.2);
+    vector<Route> routes(3);
+    vector<Address> batch, primes, fixed;
+    for (int b = 0; day.next_batch(batch, primes, 500); b++){
+        routes[b % 3].add_addresses(batch);
+        fixed.insert(fixed.end(), primes.begin(), primes.end());
+    }
+    string path = "/tmp/instance_file_test.bin";
+    InstanceFile::write(path, routes, fixed);
+    {
+        InstanceFile file(path);
+        assert( file.routes() == 3 );
+        assert( file.stops() == routes[0].size() + routes[1].size() + routes[2].size() - 6 );
+        for (int r = 0; r < 3; r++){
+            Route loaded = file.route(r);
+            assert( loaded.as_string() == routes[r].as_string() );
+            assert( loaded.length() == routes[r].length() );
+        }
+        vector<Address> loaded_primes = file.primes();
+        AddressList prime_list(fixed);
+        for (Address &a: loaded_primes){
+            assert( prime_list.in(a) );
+        }
+        Coordinates coords;
+        for (long long k = 0; k < file.stops(); k++){
+            coords.push_back(Address(file.xs()[k], file.ys()[k]));
+        }
+        assert( file.nearest(123.4, 56.7) == nearest_index(coords, 123.4, 56.7) );
+        InstanceFile::View second = file.route_view(1);
+        assert( second.size == routes[1].size() - 2 and second.xs == file.xs() + file.route_start(1) );
+        vector<Address> second_stops = routes[1].my_addresses();
+        for (long long k = 0; k < second.size; k++){
+            assert( second.address(k).key() == second_stops[k + 1].key() );
+            assert( second.primes[k] == prime_list.in(second_stops[k + 1]) );
+        }
+        bool refused = false;
+        try {
+            file.route(3);
+        } catch (const char *) {
+            refused = true;
+        }
+        assert( refused );
+    }
+    // truncated, or with route boundaries out of order: refused on load
+    auto refuses = [&](std::function<void(int fd)> damage){
+        int fd = open(path.c_str(), O_RDWR);
+        damage(fd);
+        close(fd);
+        try {
+            InstanceFile broken(path);
+        } catch (const char *) {
+            return true;
+        }
+        return false;
+    };
+    uint64_t backwards = 1 << 30;
+    bool backwards_refused = refuses([&](int fd){
+        // route_start[1], just past the 24-byte header and route_start[0]
+        ssize_t written = pwrite(fd, &backwards, sizeof backwards, 24 + 8);
+        assert( written == sizeof backwards );
+    });
+    assert( backwards_refused );
+    bool truncated_refused = refuses([&](int fd){
+        int cut = ftruncate(fd, 100);
+        assert( cut == 0 );
+    });
+    assert( truncated_refused );
+    unlink(path.c_str());
+}
+
+void read_instance_test(){
+    // TSPLIB and CSV land as one route with the depot moved to (0, 0)
+    string tsp = "/tmp/read_instance_test.vrp", csv = "/tmp/read_instance_test.csv", sol = "/tmp/read_instance_test.sol";
+    FILE *out = fopen(tsp.c_str(), "w");
+    fprintf(out, "NAME : tiny-n5\nCOMMENT : (Min no of trucks: 1, Optimal value: 24)\nTYPE : CVRP\n"
+        "DIMENSION : 5\nEDGE_WEIGHT_TYPE : EUC_2D\nNODE_COORD_SECTION\n"
+        " 1 5 5\n 2 5 1\r\n 3 9 1\n 4 9 5\n 5 3 3\nDEMAND_SECTION\n1 0\n2 1\nDEPOT_SECTION\n 5\n -1\nEOF\n");
+    fclose(out);
+    out = fopen(csv.c_str(), "w");
+    fprintf(out, "x,y\n10,10\n12,10\n10,13");
+    fclose(out);
+    out = fopen(sol.c_str(), "w");
+    fprintf(out, "a280 : 2579\ntiny-n5 : 24\n");
+    fclose(out);
+
+    InstanceInfo info;
+    Route route = read_instance(tsp, info);
+    assert( info.name == "tiny-n5" and info.nodes == 5 and info.optimal == 24 );
+    assert( info.depot_x == 3 and info.depot_y == 3 );
+    assert( route.size() == 6 );
+    assert( route.in(Address(2, 2)) and route.in(Address(2, -2)) and route.in(Address(6, -2)) );
+    assert( fabs(info.gap(30) - 25) < 1e-9 );
+
+    route = read_instance(csv, info);
+    assert( info.nodes == 3 and info.optimal < 0 and route.size() == 4 );
+    assert( route.in(Address(2, 0)) and route.in(Address(0, 3)) );
+    assert( read_optimal_values(sol)["a280"] == 2579 );
+
+    // ids from 0, with node 0 declared as the depot after the others
+    out = fopen(tsp.c_str(), "w");
+    fprintf(out, "NAME : zero\nTYPE : TSP\nDIMENSION : 3\nEDGE_WEIGHT_TYPE : EUC_2D\n"
+        "NODE_COORD_SECTION\n1 4 4\n0 1 1\n2 1 5\nDEPOT_SECTION\n0\n-1\nEOF\n");
+    fclose(out);
+    route = read_instance(tsp, info);
+    assert( info.depot_x == 1 and info.depot_y == 1 and route.size() == 4 );
+    assert( route.in(Address(3, 3)) and route.in(Address(0, 4)) );
+
+    // CSV rows may carry an id first and more columns after x and y
+    out = fopen(csv.c_str(), "w");
+    fprintf(out, "id,x,y,demand\n1,10,10,0\n2,12,10,7\n3,10,13,2\n");
+    fclose(out);
+    route = read_instance(csv, info);
+    assert( route.size() == 4 and route.in(Address(2, 0)) and route.in(Address(0, 3)) );
+
+    // two nodes in one place are refused, not silently merged
+    out = fopen(csv.c_str(), "w");
+    fprintf(out, "x,y\n10,10\n12,10\n12,10\n");
+    fclose(out);
+    bool refused = false;
+    try {
+        read_instance(csv, info);
+    } catch (const char *) {
+        refused = true;
+    }
+    assert( refused );
+    unlink(tsp.c_str());
+    unlink(csv.c_str());
+    unlink(sol.c_str());
+}
+
+float walked(Route &route){
+    // the route's length summed afresh, in the order length() adds it
+    vector<Address> stops = route.my_addresses();
+    float total = 0;
+    for (size_t k = 1; k < stops.size(); k++){
+        total += stops[k - 1].distance(stops[k]);
+    }
+    return total;
+}
+
+void route_length_test(){
+    // the cached prefix sums agree exactly with a fresh walk after every edit
+    Rng rng(23);
+    Route route, other;
+    for (int k = 0; k < 60; k++){
+        float x = rng(50), y = rng(50);
+        route.add_address(Address(x, y));
+        float u = rng(50), v = rng(50);
+        other.add_address(Address(u, v));
+    }
+    assert( route.length() == walked(route) );
+    for (int step = 0; step < 120; step++){
+        int a = 1 + rng(route.size() - 3), b = a + rng(route.size() - 2 - a);
+        int p = (a + 5) % (route.size() - 1);
+        if (step % 4 == 0){
+            route.reverse(a, b);
+        } else if (step % 4 == 1 and (p < a - 1 or p > b)){
+            route.insert_segment(a, b, p, step % 8 == 1);
+        } else if (step % 4 == 2){
+            route.swap(other, a, 1, a, 2, false, false);
+        } else if (step % 4 == 3){
+            route.erase(a);
         }
+        assert( route.length() == walked(route) and other.length() == walked(other) );
+    }
+    assert( route.size() > 10 );
+    vector<Address> stops = route.my_addresses();
+    float middle = 0;
+    for (int k = 3; k < 9; k++){
+        middle += stops[k].distance(stops[k + 1]);
+    }
+    assert( fabs(route.length(3, 9) - middle) < 1e-3 );
+    route.opt2();
+    assert( route.length() == walked(route) );
 
-        bool anyin(int start, int end){
-            for(Address a: addresses){
-                for(int i = start; i <= end; i++){
-                    if(addresses[i].distance(a) == 0){
-                        return true;
-                    }
-                }
-            }
-            return false;
-        }
+    // erasing at the tail, one stop or a range ending there
+    AddressList line(vector<Address>{Address(0,0), Address(1,0), Address(9,0)});
+    assert( line.length() == 9 );
+    line.erase(2);
+    assert( line.length() == 1 );
+    AddressList longer(vector<Address>{Address(0,0), Address(1,0), Address(10,0), Address(19,0)});
+    assert( longer.length() == 19 );
+    longer.erase(2, 3);
+    assert( longer.length() == 1 );
+}
 
-        bool anyin_subsection(vector<Address> addresslist, int start, int end){
-            for(int i = start; i <= end; i++){
-                for(Address a: addresslist){
-                    if(addresses[i].distance(a) == 0){
-                        return true;
-                    }
-                }
+void position_index_test(){
+    // positions match a plain vector's through insertions anywhere
+    Rng rng(5);
+    PositionIndex index;
+    index.build(50);
+    vector<int> order(50);
+    for (int id = 0; id < 50; id++){
+        order[id] = id;
+    }
+    for (int step = 0; step < 2000; step++){
+        int p = rng(order.size() + 1);
+        int id = index.insert(p);
+        assert( id == (int) order.size() );
+        order.insert(order.begin() + p, id);
+        if (step % 100 == 0){
+            for (int k = 0; k < (int) order.size(); k++){
+                assert( index.position(order[k]) == k );
             }
-            return false;
         }
+    }
+    assert( index.size() == (int) order.size() );
+    for (int k = 0; k < (int) order.size(); k++){
+        assert( index.position(order[k]) == k );
+    }
+}
 
-        void insert(Address a, int p){
-            addresses.insert(addresses.begin() + p, a);
+void cheapest_insertion_test(){
+    // with every stop as a neighbour, cheapest insertion through the index
+    // matches a scan of every edge, so positions stay right as stops arrive
+    Rng rng(17);
+    Route indexed;
+    indexed.set_cheapest_insertion(true, 1000);
+    vector<Address> plain = {Address(0, 0), Address(0, 0)};
+    for (int k = 0; k < 300; k++){
+        float x = rng(1000), y = rng(1000);
+        Address a(x, y);
+        indexed.add_address(a);
+        int best = plain.size() - 1;
+        float best_cost = std::numeric_limits<float>::infinity();
+        for (int p = 1; p < (int) plain.size(); p++){
+            float cost = plain[p - 1].distance(a) + a.distance(plain[p]) - plain[p - 1].distance(plain[p]);
+            if (cost < best_cost){
+                best = p;
+                best_cost = cost;
+            }
         }
+        plain.insert(plain.begin() + best, a);
+    }
+    assert( indexed.as_string() == Route(plain).as_string() );
 
-        void erase(int p){
-            addresses.erase(addresses.begin() + p);
+    // neighbour-limited, one at a time or in batches, it beats appending
+    Workload day(Workload::clustered, 20000, 4);
+    Route appended, single, batched;
+    single.set_cheapest_insertion(true);
+    batched.set_cheapest_insertion(true);
+    vector<Address> batch, primes;
+    while (day.next_batch(batch, primes, 1000)){
+        appended.add_addresses(batch);
+        batched.add_addresses(batch);
+        for (Address &a: batch){
+            single.add_address(a);
         }
+    }
+    assert( single.size() == appended.size() and batched.size() == appended.size() );
+    for (Address &a: appended.my_addresses()){
+        assert( single.in(a) and batched.in(a) );
+    }
+    assert( single.length() < appended.length() / 10 );
+    assert( batched.length() < appended.length() / 10 );
+}
 
-        void erase(int start, int end){
-            for (int i = end; i >= start; i--){
-                addresses.erase(addresses.begin() + i);
-            }
-        }
+bool same_stops(vector<Address> a, vector<Address> b){
+    // whether a and b hold the same coordinates, counting repeats
+    vector<uint64_t> ka, kb;
+    for (Address &x: a){
+        ka.push_back(x.key());
+    }
+    for (Address &x: b){
+        kb.push_back(x.key());
+    }
+    std::sort(ka.begin(), ka.end());
+    std::sort(kb.begin(), kb.end());
+    return ka == kb;
+}
 
-        Address pick_random(){
-            return addresses[rand() % size()];
-        }
+vector<Address> stops_of(Route &route_a, Route &route_b){
+    vector<Address> both = route_a.my_addresses();
+    for (Address &a: route_b.my_addresses()){
+        both.push_back(a);
+    }
+    return both;
+}
 
-        vector<Address> my_addresses(){
-            return addresses;
-        }
+void add_addresses_test(){
+    // a batch keeps the first of each coordinate, whether it repeats
+    // within the batch or matches a stop already there
+    AddressList list;
+    list.add_address(Address(1, 1));
+    list.add_addresses(vector<Address>{Address(2, 2), Address(1, 1), Address(3, 3), Address(2, 2), Address(-0.f, 4)});
+    list.add_addresses(vector<Address>{Address(0, 4), Address(3, 3), Address(5, 5)});
+    vector<Address> kept = list.my_addresses();
+    assert( list.size() == 5 );
+    assert( same_stops(kept, {Address(1, 1), Address(2, 2), Address(3, 3), Address(0, 4), Address(5, 5)}) );
+    assert( kept[1].key() == Address(2, 2).key() and kept[2].key() == Address(3, 3).key() );
 
-};
+    // a route also refuses the depot's coordinates and keeps its depots
+    Route route;
+    route.add_address(Address(1, 1));
+    route.add_addresses(vector<Address>{Address(0, 0), Address(2, 2), Address(1, 1), Address(2, 2)});
+    vector<Address> stops = route.my_addresses();
+    assert( route.size() == 4 );
+    assert( stops.front().key() == Address(0, 0).key() and stops.back().key() == Address(0, 0).key() );
+    assert( stops[1].key() == Address(1, 1).key() and stops[2].key() == Address(2, 2).key() );
+    // membership stays exact: each kept stop is in once, and erasing it
+    // lets it back in
+    route.erase(1);
+    assert( not route.in(Address(1, 1)) and route.in(Address(2, 2)) );
+    route.add_addresses(vector<Address>{Address(1, 1)});
+    assert( route.size() == 4 and route.in(Address(1, 1)) );
+}
 
-class Route : public AddressList {
-    private:
-        Address depot = Address(0,0);
-    public:
-        Route() : AddressList(){
-            addresses = {
-                depot, depot
-            };
+void opt2_convergence_test(){
+    // opt2 stops at a 2-opt local optimum: no reversal left shortens the
+    // route beyond float noise, and the cached length is a fresh walk's
+    Rng rng(37);
+    for (int round = 0; round < 4; round++){
+        Route route;
+        for (int k = 0; k < 60; k++){
+            float x = rng(1000), y = rng(1000);
+            route.add_address(Address(x, y));
         }
-        Route(vector<Address> source) : AddressList(source){}
-
-        void clear(){
-            addresses = {depot, depot};
+        if (round % 2){
+            route = route.greedy_route();
         }
-
-        void add_address(Address newaddress){
-            addresses.pop_back();
-            AddressList :: add_address(newaddress);
-            addresses.push_back(depot);
+        vector<Address> before = route.my_addresses();
+        route.opt2();
+        assert( route.length() == walked(route) );
+        assert( same_stops(before, route.my_addresses()) );
+        float length = route.length();
+        vector<Address> stops = route.my_addresses();
+        for (int n = 1; n < route.size() - 1; n++){
+            for (int m = 1; m < n; m++){
+                // the most a reversal may gain and still be taken for noise,
+                // plus rounding in the two sums
+                float removed = stops[m - 1].distance(stops[m]) + stops[n].distance(stops[n + 1]);
+                Route reversed = route;
+                reversed.reverse(m, n);
+                assert( length - reversed.length() <= removed * 1e-5f + length * 1e-6f );
+            }
         }
+        bool again = route.opt2();
+        assert( not again and route.length() == length );
+    }
+}
 
-        Route greedy_route(){
-            // returns a new route that is greedily optimal
-            // construct subvector of all but last stop (depot)
-            addresses.pop_back(); 
-            AddressList subvector = AddressList(addresses);
-            addresses.push_back(depot);
-            // constuct and return greedy search output, including depot at end
-            vector<Address> greedy_output = subvector.greedy_route();
-            greedy_output.push_back(depot);
-            return Route(greedy_output);
+void multi_opt2_convergence_test(){
+    // repeated multi_opt2 ends where no segment exchange, facing either
+    // way, shortens the pair beyond float noise, and both cached lengths
+    // are fresh walks
+    Rng rng(43);
+    for (int round = 0; round < 3; round++){
+        Route route_a, route_b;
+        for (int k = 0; k < 12; k++){
+            float ax = rng(100), ay = rng(100), bx = rng(100), by = rng(100);
+            route_a.add_address(Address(ax, ay));
+            route_b.add_address(Address(bx, by));
         }
-
-        void reverse(int index1, int index2){
-            // reverses route segment in place
-            vector<Address> temp;
-            for(int i = index2; i >= index1; i--){
-                temp.push_back(addresses[i]);
-            }
-            for(int j = index1; j <= index2; j++){
-                addresses[j] = temp[j - index1];
-            }
+        vector<Address> before = stops_of(route_a, route_b);
+        int moves = 0;
+        while (route_a.multi_opt2(route_b)){
+            assert( route_a.length() == walked(route_a) and route_b.length() == walked(route_b) );
+            moves++;
         }
- 
-        void opt2(){
-            // loop over subarray not consisting of depots;
-            // cannot reverse depot segments
-            float min_length = length();
-            float curr_length;
-            for(int n = 1; n < size() - 1; n++){
-                for(int m = 1; m < n; m++){
-                    reverse(m, n);
-                    curr_length = length();
-                    if (curr_length < min_length){
-                        min_length = curr_length;
-                    } else {
-                        reverse(m, n); // basically if curr_length is longer, 
-                        // undo the reverse
+        assert( moves > 0 and same_stops(before, stops_of(route_a, route_b)) );
+        float total = route_a.length() + route_b.length();
+        vector<Address> a_stops = route_a.my_addresses(), b_stops = route_b.my_addresses();
+        for (int m = 1; m < route_a.size() - 1; m++){
+            for (int n = m + 1; n < route_a.size() - 1; n++){
+                for (int j = 1; j < route_b.size() - 1; j++){
+                    for (int i = j + 1; i < route_b.size() - 1; i++){
+                        float removed = a_stops[m - 1].distance(a_stops[m]) + a_stops[n].distance(a_stops[n + 1])
+                            + b_stops[j - 1].distance(b_stops[j]) + b_stops[i].distance(b_stops[i + 1]);
+                        for (int variant = 0; variant < 4; variant++){
+                            Route a = route_a, b = route_b;
+                            a.swap(b, m, j, n, i, variant & 1, variant & 2);
+                            assert( total - (a.length() + b.length()) <= removed * 1e-5f + total * 1e-6f );
+                        }
                     }
                 }
-
             }
         }
+    }
+}
 
-        void multi_opt2(Route &other_route){
-            // assume only 2 routes optimizing for (mention pairwise+ search in writeup?)
-            // minimization criteria will be total length of routes
-            // the nested loops extend op2 by considering 4 possible routes:
-            // pure swap (..., i, ..., j, ...) (..., m, ..., n...)
-            // swap, reverse 1 (..., j, ..., i, ...) (..., m, ..., n...)
-            // swap, reverse 2 (..., i, ..., j, ...) (..., n, ..., m...)
-            // swap, reverse both (..., i, ..., j, ...) (..., m, ..., n...)
-            // iterate over all subsets of the route not containing endpoints
-            int min_m, min_j, min_n, min_i;
-            bool min_swap_1, min_swap_2;
-            float min_total = length() + other_route.length();
-            float pure_length, rev1_length, rev2_length, rev_both_length;
-
-            min_m = -1;
-
-            for (int n = 1; n < size() - 1; n++){
-                for(int m = 1; m < n; m++){
-                   //iterate over all subsets of other route not containing endpoints
-                   for (int i = 1; i < other_route.size() - 1; i++){
-                       for (int j = 1; j < i; j++){
-                           //try_swap(other_route, m, j, n, i, false, false); //pure swap
-                           //try_swap(other_route, m, j, n, i, true, false); //swap, reverse 1
-                           //try_swap(other_route, m, j, n, i, false, true); //swap, reverse 2
-                           //try_swap(other_route, m, j, n, i, true, true); //swap, reverse both
-
-                           pure_length = try_swap(other_route, m, j, n, i, false, false); //pure swap
-                           rev1_length = try_swap(other_route, m, j, n, i, true, false); //swap, reverse 1
-                           rev2_length = try_swap(other_route, m, j, n, i, false, true); //swap, reverse 2
-                           rev_both_length = try_swap(other_route, m, j, n, i, true, true); //swap, reverse both
-
-                           if(pure_length < min_total){
-                               min_m = m; min_j = j; min_n = n; min_i = i;
-                               min_swap_1 = false; min_swap_2 = false;
-                               min_total = pure_length;
-                           }
-                           if(rev1_length < min_total){
-                               min_m = m; min_j = j; min_n = n; min_i = i;
-                               min_swap_1 = true; min_swap_2 = false;
-                               min_total = pure_length;
-                           }
-                           if(rev2_length < min_total){
-                               min_m = m; min_j = j; min_n = n; min_i = i;
-                               min_swap_1 = false; min_swap_2 = true;
-                               min_total = pure_length;
-                           }
-                           if(rev_both_length < min_total){
-                               min_m = m; min_j = j; min_n = n; min_i = i;
-                               min_swap_1 = true; min_swap_2 = true;
-                               min_total = pure_length;
-                           }
-                       }
-                   }
-                }
-            }
-            if (min_m > 0){
-                swap(other_route, min_m, min_j, min_n, min_i, min_swap_1, min_swap_2);
-            }
-        }
-
-        void multi_opt2(Route &other_route, vector<Address> fixed_sites){
-            // assume only 2 routes optimizing for (mention pairwise+ search in writeup?)
-            // minimization criteria will be total length of routes
-            // the nested loops extend op2 by considering 4 possible routes:
-            // pure swap (..., i, ..., j, ...) (..., m, ..., n...)
-            // swap, reverse 1 (..., j, ..., i, ...) (..., m, ..., n...)
-            // swap, reverse 2 (..., i, ..., j, ...) (..., n, ..., m...)
-            // swap, reverse both (..., i, ..., j, ...) (..., m, ..., n...)
-            // iterate over all subsets of the route not containing endpoints
-
-            //store parameters associated with min length swap result
-            int min_m, min_j, min_n, min_i;
-            bool min_swap_1, min_swap_2;
-            float min_total = length() + other_route.length();
-            float pure_length, rev1_length, rev2_length, rev_both_length;
-            min_m = -1;
-            for (int n = 1; n < size() - 1; n++){
-                for(int m = 1; m < n; m++){
-                   //iterate over all subsets of other route not containing endpoints
-                   for (int i = 1; i < other_route.size() - 1; i++){
-                       for (int j = 1; j < i; j++){
-                           if (anyin_subsection(fixed_sites, m, n) or other_route.anyin_subsection(fixed_sites, j, i)){
-                               continue;
-                           } else {
-                               pure_length = try_swap(other_route, m, j, n, i, false, false); //pure swap
-                               rev1_length = try_swap(other_route, m, j, n, i, true, false); //swap, reverse 1
-                               rev2_length = try_swap(other_route, m, j, n, i, false, true); //swap, reverse 2
-                               rev_both_length = try_swap(other_route, m, j, n, i, true, true); //swap, reverse both
-
-                               if(pure_length < min_total){
-                                   min_m = m; min_j = j; min_n = n; min_i = i;
-                                   min_swap_1 = false; min_swap_2 = false;
-                                   min_total = pure_length;
-                               }
-                               if(rev1_length < min_total){
-                                   min_m = m; min_j = j; min_n = n; min_i = i;
-                                   min_swap_1 = true; min_swap_2 = false;
-                                   min_total = pure_length;
-                               }
-                               if(rev2_length < min_total){
-                                   min_m = m; min_j = j; min_n = n; min_i = i;
-                                   min_swap_1 = false; min_swap_2 = true;
-                                   min_total = pure_length;
-                               }
-                               if(rev_both_length < min_total){
-                                   min_m = m; min_j = j; min_n = n; min_i = i;
-                                   min_swap_1 = true; min_swap_2 = true;
-                                   min_total = pure_length;
-                               }
-                           }
-                       }
-                   }
-                }
-            }
-
-            if (min_m > 0){
-                swap(other_route, min_m, min_j, min_n, min_i, min_swap_1, min_swap_2);
-            }
+void segment_moves_test(){
+    // each move type only shortens the route, keeps its stops and leaves
+    // the cached length equal to a fresh walk
+    Rng rng(29);
+    for (int move = 0; move < 4; move++){
+        Route route;
+        for (int k = 0; k < 120; k++){
+            float x = rng(500), y = rng(500);
+            route.add_address(Address(x, y));
         }
+        route.opt2();
+        vector<Address> before = route.my_addresses();
+        float length = route.length();
+        bool moved = move == 0 ? route.move_segments(2)
+            : move == 1 ? route.or_opt()
+            : move == 2 ? route.opt3()
+            : route.vnd();
+        assert( moved and route.length() < length );
+        assert( route.length() == walked(route) );
+        assert( same_stops(before, route.my_addresses()) );
+        // a second pass finds nothing: the route is a local optimum
+        length = route.length();
+        moved = move == 0 ? route.move_segments(2)
+            : move == 1 ? route.or_opt()
+            : move == 2 ? route.opt3()
+            : route.vnd();
+        assert( not moved and route.length() == length );
+    }
+}
 
-        float try_swap(Route &other_route, int my_start, int other_start, 
-            int my_end, int other_end, bool reverse_me, bool reverse_other) {
-            // test swap, calculates total length from swap, unswap, return length
+void lin_kernighan_test(){
+    // single route: the depots stay at both ends and the route never grows
+    Address depot(0, 0);
+    for (uint64_t seed = 1; seed <= 4; seed++){
+        Workload day(Workload::clustered, 300, seed, 1000, 0);
+        vector<Address> stops, primes;
+        day.next_batch(stops, primes, 300);
+        Route route;
+        route.add_addresses(stops);
+        vector<Address> before = route.my_addresses();
+        float length = route.length();
+        bool changed = route.lin_kernighan();
+        vector<Address> after = route.my_addresses();
+        assert( changed and route.length() < length );
+        assert( after.front().key() == depot.key() and after.back().key() == depot.key() );
+        assert( same_stops(before, after) );
+        length = route.length();
+        route.lin_kernighan();
+        assert( route.length() <= length );
+    }
 
-            float total_curr_length;
+    // two routes: fixed stops stay on their route and no stop is lost
+    for (uint64_t seed = 1; seed <= 4; seed++){
+        Workload day(Workload::uniform, 200, seed, 1000, 0.3);
+        vector<Address> stops, primes;
+        day.next_batch(stops, primes, 200);
+        Route route_a, route_b;
+        for (int k = 0; k < 200; k++){
+            (k % 2 ? route_b : route_a).add_address(stops[k]);
+        }
+        vector<Address> before = stops_of(route_a, route_b);
+        vector<Address> a_primes, b_primes;
+        for (Address &a: primes){
+            (route_a.in(a) ? a_primes : b_primes).push_back(a);
+        }
+        float length = route_a.length() + route_b.length();
+        bool changed = route_a.lin_kernighan(route_b, primes);
+        assert( changed and route_a.length() + route_b.length() < length );
+        assert( same_stops(before, stops_of(route_a, route_b)) );
+        for (Address &a: a_primes){
+            assert( route_a.in(a) and not route_b.in(a) );
+        }
+        for (Address &a: b_primes){
+            assert( route_b.in(a) and not route_a.in(a) );
+        }
+        for (Route *route: {&route_a, &route_b}){
+            vector<Address> order = route->my_addresses();
+            assert( order.front().key() == depot.key() and order.back().key() == depot.key() );
+        }
+    }
+}
 
-            swap(other_route, my_start, other_start, my_end, other_end, reverse_me, reverse_other);
-            total_curr_length = length() + other_route.length();
-            unswap(other_route, my_start, other_start, my_end, other_end, reverse_me, reverse_other);
-            return total_curr_length;
+void candidate_list_test(){
+    // the candidate-list searches only keep moves that shorten the routes,
+    // keep every stop, and land close to the exhaustive searches
+    float knn_total = 0, full_total = 0, multi_knn_total = 0, multi_full_total = 0;
+    for (uint64_t seed = 1; seed <= 6; seed++){
+        Workload day(Workload::uniform, 60, seed, 1000, 0.2);
+        vector<Address> stops, primes;
+        day.next_batch(stops, primes, 60);
+        Route route;
+        route.add_addresses(stops);
+        Route full = route;
+        float before = route.length();
+        bool moved = route.opt2_knn();
+        assert( moved and route.length() < before );
+        assert( same_stops(route.my_addresses(), full.my_addresses()) );
+        full.opt2();
+        knn_total += route.length();
+        full_total += full.length();
 
+        Route route_a, route_b;
+        for (int k = 0; k < 60; k++){
+            (k % 2 ? route_b : route_a).add_address(stops[k]);
         }
-        void swap(Route &other_route, int my_start, int other_start, 
-            int my_end, int other_end, bool reverse_me, bool reverse_other) {
-            if(my_start == 0 or other_start == 0 or my_end == size() or other_end == other_route.size()){
-                cout << my_start << other_start << my_end << other_end << endl;
-                cout << "aaaaa" << endl;
-                throw "cannot swap links containing depot";
-            }
-            vector<Address> temp;
-            for(int i = my_start; i <= my_end; i++){
-                temp.push_back(addresses[i]);
-            }
+        route_a.opt2();
+        route_b.opt2();
+        vector<Address> all_stops = stops_of(route_a, route_b), a_stops = route_a.my_addresses();
+        Route full_a = route_a, full_b = route_b;
+        float total = route_a.length() + route_b.length();
+        int moves = 0;
+        while (route_a.multi_opt2_knn(route_b, primes)){
+            float now = route_a.length() + route_b.length();
+            assert( now < total );
+            total = now;
+            moves++;
+        }
+        assert( moves > 0 );
+        assert( same_stops(stops_of(route_a, route_b), all_stops) );
+        for (Address &a: primes){
+            bool was_a = std::any_of(a_stops.begin(), a_stops.end(), [&](Address &b){ return b.key() == a.key(); });
+            assert( route_a.in(a) == was_a and route_b.in(a) != was_a );
+        }
+        while (full_a.multi_opt2(full_b, primes)){}
+        multi_knn_total += total;
+        multi_full_total += full_a.length() + full_b.length();
+    }
+    assert( knn_total < full_total * 1.03f );
+    assert( multi_knn_total < multi_full_total * 1.03f );
+}
 
-            vector<Address> other_temp;
-            for(int i = other_start; i <= other_end; i++){
-                other_temp.push_back(other_route.addresses[i]);
-            }
+void incremental_opt2_test(){
+    Rng rng(23);
+    Route route;
+    for (int k = 0; k < 3000; k++){
+        float x = rng(1000), y = rng(1000);
+        route.add_address(Address(x, y));
+    }
+    // never settled: searched in full, then nothing is left to do
+    bool first = route.opt2_incremental();
+    bool again = route.opt2_incremental();
+    assert( first and not again and route.dirty_stops() == 0 );
 
-            erase(my_start, my_end);
-            other_route.erase(other_start, other_end);
+    // deliver a few stops and take on a few new ones
+    for (int k = 0; k < 10; k++){
+        route.erase(1 + rng(route.size() - 2));
+    }
+    for (int k = 0; k < 20; k++){
+        float x = rng(1000), y = rng(1000);
+        route.add_address(Address(x, y));
+    }
+    assert( route.dirty_stops() <= 4 * 10 + 3 * 20 );
+    Route full = route;
+    float before = route.length();
+    // only the stops around the changes are searched from, and the result
+    // comes within 1% of a full candidate-list pass
+    bool moved = route.opt2_incremental();
+    full.opt2_knn();
+    assert( moved );
+    assert( route.dirty_stops() == 0 );
+    assert( route.size() == full.size() );
+    for (Address &a: full.my_addresses()){
+        assert( route.in(a) );
+    }
+    assert( route.length() < before and route.length() < full.length() * 1.01f );
+}
 
-            for(int i = 0; i < other_temp.size(); i++){
-                insert(other_temp[i], my_start + i);
-            }
+void instruments_test(){
+    // counts and times add up per thread and a dump clears them
+    Instruments &mine = Instruments::local();
+    mine.reset();
+    mine.add(Instruments::Counter::swap_calls, 3);
+    {
+        PhaseTimer timer(Instruments::Phase::swap);
+    }
+    assert( mine.count(Instruments::Counter::swap_calls) == 3 );
+    assert( mine.time(Instruments::Phase::swap) >= 0 );
+    std::thread([]{
+        assert( Instruments::local().count(Instruments::Counter::swap_calls) == 0 );
+    }).join();
+    mine.dump("test");
+    assert( mine.count(Instruments::Counter::swap_calls) == 0 );
+#ifdef ROUTE_STATS
+    // the searches count through the macros when compiled in
+    Route route_a(vector<Address>{Address(0,0), Address(0,2), Address(2,3), Address(3,2), Address(2,0), Address(0,0)});
+    Route route_b(vector<Address>{Address(0,0), Address(1,3), Address(1,2), Address(2,1), Address(3,1), Address(0,0)});
+    route_a.try_swap(route_b, 1, 1, 2, 2, false, false);
+    route_a.opt2();
+    assert( mine.count(Instruments::Counter::try_swap_calls) == 1 );
+    assert( mine.count(Instruments::Counter::swap_calls) == 2 and mine.count(Instruments::Counter::unswap_calls) == 1 );
+    assert( mine.count(Instruments::Counter::opt2_evaluated) > 0 and mine.count(Instruments::Counter::distance_evaluations) > 0 );
+    mine.reset();
+#endif
+}
 
-            for(int i = 0; i < temp.size(); i++){
-                other_route.insert(temp[i], other_start + i);
+void tempering_test(){
+    Rng rng(31);
+    Route route_a, route_b;
+    vector<Address> fixed;
+    for (int k = 0; k < 120; k++){
+        float x = rng(100), y = rng(100);
+        Address a(x, y);
+        if (k % 2){
+            route_b.add_address(a);
+        } else {
+            route_a.add_address(a);
+            if (rng(3) == 0){
+                fixed.push_back(a);
             }
         }
+    }
+    float before = route_a.length() + route_b.length();
+    Route serial_a = route_a, serial_b = route_b;
+    Route cooled_a = route_a, cooled_b = route_b;
+    Tempering parallel(route_a, route_b, fixed, 5);
+    parallel.set_replicas(6);
+    parallel.set_threads(4);
+    parallel.set_schedule(40, 2000);
+    float after = parallel.run();
+    // shorter, every stop still served once, fixed stops where they were
+    assert( after < before * 0.6f and after == route_a.length() + route_b.length() );
+    assert( route_a.size() + route_b.size() == serial_a.size() + serial_b.size() );
+    for (Address &a: serial_a.my_addresses()){
+        assert( route_a.in(a) or route_b.in(a) );
+    }
+    for (Address &a: fixed){
+        assert( route_a.in(a) );
+    }
+    // the same seed gives the same routes on any number of threads
+    Tempering serial(serial_a, serial_b, fixed, 5);
+    serial.set_replicas(6);
+    serial.set_threads(1);
+    serial.set_schedule(40, 2000);
+    serial.run();
+    assert( serial_a.as_string() == route_a.as_string() and serial_b.as_string() == route_b.as_string() );
+    // independent annealing runs from the same starting point also improve
+    Tempering cooling(cooled_a, cooled_b, fixed, 9);
+    cooling.set_exchange(false);
+    cooling.set_replicas(4);
+    cooling.set_schedule(40, 2000);
+    float cooled = cooling.run();
+    assert( cooled < before * 0.6f );
+}
 
-        void unswap(Route &other_route, int my_start, int other_start, 
-            int my_end, int other_end, bool reverse_me, bool reverse_other) {
-            // using the exact same parameters for the original swap, reverse that effect
-            int my_diff =  my_end - my_start;
-            int other_diff = other_end - other_start;
-            swap(other_route, my_start, other_start, my_start + other_diff, other_start + my_diff, reverse_me, reverse_other);
-        }
+void anytime_test(){
+    // a big route gets cut off near its budget, never longer than it
+    // started; how far it gets depends on the build's speed
+    Workload day(Workload::uniform, 30000, 3);
+    vector<Address> batch, primes;
+    Route big;
+    while (day.next_batch(batch, primes)){
+        big.add_addresses(batch);
+    }
+    Route unhurried = big;
+    Deadline tight(0.05);
+    AnytimeReport cut = big.optimize(tight);
+    assert( not cut.converged and cut.final_length <= cut.initial_length );
+    assert( cut.used < cut.budget + 0.5 and cut.final_length == big.length() );
+    // with time to spare past the setup it improves
+    Deadline generous(1);
+    AnytimeReport ample = unhurried.optimize(generous);
+    assert( ample.final_length < ample.initial_length );
 
-        string as_string(){
-            string output = "";
-            for (Address a: addresses) {
-                output.append(a.as_string());
-            }
-            return output;
+    // small problems finish well inside theirs
+    Rng rng(4);
+    Route route_a, route_b;
+    vector<Address> fixed;
+    for (int k = 0; k < 80; k++){
+        float x = rng(100), y = rng(100);
+        (k % 2 ? route_b : route_a).add_address(Address(x, y));
+        if (k % 6 == 0){
+            fixed.push_back(Address(x, y));
         }
-        
-        
-};
-
-void evaluate(Route route1, Route route2){
-    cout << "route 1: " ;
-    route1.print();
-    //cout << "route 1 length: " << route1.length() << endl;
-    cout << "route 2: " ;
-    route2.print();
-    //cout << "route 2 length: " << route2.length() << endl;
-    cout << "total length : " << route1.length() + route2.length();
-    cout << endl;
+    }
+    Route alone = route_a;
+    Deadline roomy(10);
+    AnytimeReport single = alone.optimize(roomy);
+    assert( single.converged and single.used < single.budget );
+    assert( single.phases[0].first == "opt2_knn" and single.final_length < single.initial_length );
+    Deadline pair_budget(10);
+    AnytimeReport pair = route_a.optimize(route_b, fixed, pair_budget);
+    assert( pair.converged and pair.final_length < pair.initial_length );
+    for (Address &a: fixed){
+        assert( route_a.in(a) );
+    }
+    Fleet fleet({alone, route_b});
+    Deadline fleet_budget(10);
+    AnytimeReport whole = fleet.optimize(fleet_budget);
+    assert( whole.converged and whole.final_length <= whole.initial_length );
+    assert( whole.final_length == fleet.length() );
 }
 
 void closest_index_test(){
@@ -442,6 +4519,35 @@ void closest_index_test(){
     deliveries.add_address( Address(0,5) );
     deliveries.print();
     cout << deliveries.index_closest_to( Address(5,0) ) << endl;
+
+    // the packed coordinates follow every edit
+    Route route;
+    for (int k = 1; k <= 6; k++){
+        route.add_address(Address(k * 10, 0));
+    }
+    assert( route.index_closest_to(Address(29, 1)) == 3 );
+    route.reverse(1, 6);
+    assert( route.index_closest_to(Address(29, 1)) == 4 );
+    route.erase(1);
+    route.erase(route.size() - 2);
+    assert( route.index_closest_to(Address(29, 1)) == 3 and route.index_closest_to(Address(99, 0)) == 1 );
+}
+
+void spatial_grid_test(){
+    AddressList deliveries;
+    deliveries.add_address( Address(5,5) );
+    deliveries.add_address( Address(0,5) );
+    deliveries.add_address( Address(1,1) );
+    deliveries.add_address( Address(9,9) );
+    SpatialGrid grid = deliveries.spatial_index();
+    assert( grid.nearest(5, 0) == deliveries.index_closest_to( Address(5,0) ) );
+    grid.remove(grid.nearest(5, 0));
+    cout << "next closest: " << grid.nearest(5, 0) << endl;
+    cout << "2 nearest to (6,6): ";
+    for (int id: grid.k_nearest(6, 6, 2)){
+        cout << id << " ";
+    }
+    cout << endl << "within 5 of (0,0): " << grid.within(0, 0, 5).size() << endl;
 }
 
 void opt2test(){
@@ -485,6 +4591,85 @@ void distance_test(){
     cerr << "Distance: " << one.distance(two) << "\n";
 }
 
+void distance_oracle_test(){
+    // small matrix so that most pairs fall back to direct distances
+    DistanceOracle oracle(4);
+    vector<Address> indexed;
+    for (int k = 0; k < 10; k++){
+        indexed.push_back(oracle.intern(Address(k, k * k % 7)));
+    }
+    for (int pass = 0; pass < 3; pass++){
+        for (Address &a: indexed){
+            for (Address &b: indexed){
+                float d = oracle.distance(a, b);
+                assert( d == a.distance(b) );
+            }
+        }
+    }
+    Address known = oracle.intern(Address(3, 2)), late = oracle.intern(Address(9, 4));
+    assert( known.get_index() == 3 );
+    assert( late.get_index() == -1 and oracle.size() == 4 );
+    // 4 of the 10 addresses are in the matrix, so 16 of each pass's 100 pairs hit
+    assert( fabs(oracle.hit_rate() - 0.16f) < 1e-6 );
+    oracle.report();
+    // coverage counts intern() calls on both sides, however often each
+    // address comes back
+    DistanceOracle one(1);
+    for (int k = 0; k < 100; k++){
+        one.intern(Address(1, 1));
+        one.intern(Address(2, 2));
+    }
+    assert( one.coverage() == 0.5f );
+}
+
+void two_level_tour_test(){
+    // random flips leave both representations with the same tour, through
+    // many segment splits and the rebuilds they trigger
+    Rng rng(11);
+    for (int n: {5, 17, 400}){
+        ArrayTour flat(n);
+        TwoLevelTour split(n);
+        int most = split.segment_count(), rebuilds = 0;
+        for (int step = 0; step < 3000; step++){
+            int a = rng(n), c = rng(n);
+            int b = flat.next(a), d = flat.next(c);
+            if (c == a or c == b or d == a or flat.pinned(a, b) or flat.pinned(c, d)){
+                continue;
+            }
+            assert( split.next(a) == b and split.next(c) == d );
+            flat.flip(a, b, c, d);
+            split.flip(a, b, c, d);
+            rebuilds += split.segment_count() < most;
+            most = split.segment_count();
+            assert( most <= 2 * std::sqrt((double) n) + 2 );
+            int u = rng(n), v = rng(n), w = rng(n);
+            assert( split.next(u) == flat.next(u) and split.prev(u) == flat.prev(u) );
+            assert( split.between(u, v, w) == flat.between(u, v, w) );
+        }
+        assert( split.path() == flat.path() );
+        for (int v = 0; v < n; v++){
+            assert( split.next(v) == flat.next(v) and split.prev(v) == flat.prev(v) );
+        }
+        if (n == 400){
+            assert( rebuilds > 0 );
+        }
+    }
+
+    // the 2-opt search takes the same moves on either
+    Workload day(Workload::uniform, 2000, 9, 1000, 0);
+    vector<Address> stops, primes;
+    day.next_batch(stops, primes, 2000);
+    Route route;
+    route.add_addresses(stops);
+    vector<Address> nodes = route.my_addresses();
+    Coordinates coords = route.coordinates();
+    vector<vector<int>> near = neighbour_lists(coords, 8);
+    vector<int> flat_path, split_path;
+    bool flat_moved = two_opt_search<ArrayTour>(nodes, near, flat_path);
+    bool split_moved = two_opt_search<TwoLevelTour>(nodes, near, split_path);
+    assert( flat_moved and split_moved and flat_path == split_path );
+}
+
 void reverse_test(){
     Route deliveries;
     deliveries.add_address( Address(0,5) );
@@ -500,6 +4685,60 @@ void reverse_test(){
     }
 }
 
+void fixed_sites_test(){
+    // with fixed stops in the middle of both routes, multi_opt2 finds the
+    // best exchange among the segments that hold none of them, which an
+    // exhaustive scan over every feasible exchange confirms
+    Rng rng(41);
+    int binding = 0;
+    for (int round = 0; round < 6; round++){
+        Route route_a, route_b;
+        for (int k = 0; k < 10; k++){
+            float ax = rng(100), ay = rng(100), bx = rng(100), by = rng(100);
+            route_a.add_address(Address(ax, ay));
+            route_b.add_address(Address(bx, by));
+        }
+        vector<Address> a_stops = route_a.my_addresses(), b_stops = route_b.my_addresses();
+        vector<Address> fixed = {a_stops[4], a_stops[7], b_stops[5]};
+        auto holds_fixed = [&](vector<Address> &stops, int start, int end){
+            for (int p = start; p <= end; p++){
+                for (Address &f: fixed){
+                    if (stops[p].key() == f.key()){
+                        return true;
+                    }
+                }
+            }
+            return false;
+        };
+        float best = route_a.length() + route_b.length();
+        for (int m = 1; m < route_a.size() - 1; m++){
+            for (int n = m + 1; n < route_a.size() - 1; n++){
+                for (int j = 1; j < route_b.size() - 1; j++){
+                    for (int i = j + 1; i < route_b.size() - 1; i++){
+                        if (holds_fixed(a_stops, m, n) or holds_fixed(b_stops, j, i)){
+                            continue;
+                        }
+                        for (int variant = 0; variant < 4; variant++){
+                            Route a = route_a, b = route_b;
+                            a.swap(b, m, j, n, i, variant & 1, variant & 2);
+                            best = std::min(best, a.length() + b.length());
+                        }
+                    }
+                }
+            }
+        }
+        Route free_a = route_a, free_b = route_b;
+        bool moved = route_a.multi_opt2(route_b, fixed);
+        float total = route_a.length() + route_b.length();
+        assert( moved and fabs(total - best) < 1e-3f );
+        assert( route_a.in(fixed[0]) and route_a.in(fixed[1]) and route_b.in(fixed[2]) );
+        free_a.multi_opt2(free_b);
+        binding += free_a.length() + free_b.length() < total - 1e-3f;
+    }
+    // the constraint decided the move in some rounds
+    assert( binding > 0 );
+}
+
 void multi_opt2_test(){
     Route deliveries1, deliveries2;
 
@@ -689,8 +4928,28 @@ void swap_test(){
     //deliveries1.swap(deliveries2, 0, 2, 2, 4, false, false); 
 }
 
+void swap_reverse_test(){
+    // the reverse flags orient the segments where they land, and unswap
+    // with the same arguments puts everything back
+    Route route_a(vector<Address>{Address(0,0), Address(0,2), Address(2,3), Address(3,2), Address(2,0), Address(0,0)});
+    Route route_b(vector<Address>{Address(0,0), Address(1,3), Address(1,2), Address(2,1), Address(3,1), Address(0,0)});
+    string before_a = route_a.as_string(), before_b = route_b.as_string();
+    route_a.swap(route_b, 1, 2, 2, 4, true, true);
+    Route expected_a(vector<Address>{Address(0,0), Address(3,1), Address(2,1), Address(1,2), Address(3,2), Address(2,0), Address(0,0)});
+    Route expected_b(vector<Address>{Address(0,0), Address(1,3), Address(2,3), Address(0,2), Address(0,0)});
+    assert( route_a.as_string() == expected_a.as_string() and route_b.as_string() == expected_b.as_string() );
+    assert( route_a.in(Address(3,1)) and not route_a.in(Address(0,2)) and route_b.in(Address(0,2)) );
+    assert( route_a.length() == expected_a.length() and route_b.length() == expected_b.length() );
+    route_a.unswap(route_b, 1, 2, 2, 4, true, true);
+    assert( route_a.as_string() == before_a and route_b.as_string() == before_b );
+    assert( route_a.in(Address(0,2)) and not route_a.in(Address(3,1)) and route_b.in(Address(3,1)) );
+    route_a.swap(route_b, 2, 1, 4, 1, false, true);
+    route_a.unswap(route_b, 2, 1, 4, 1, false, true);
+    assert( route_a.as_string() == before_a and route_b.as_string() == before_b );
+}
+
 void prime_ratio_test(){
-    srand(137);
+    Rng rng(137);
       
     int num_addresses = 20;
     int max_length = 20;
@@ -698,9 +4957,10 @@ void prime_ratio_test(){
     AddressList addresses = {};
 
     for(int i = 0; i < num_addresses; i++){
-        Address newaddress = Address(rand() % max_length, rand() % max_length);
+        float x = rng(max_length), y = rng(max_length);
+        Address newaddress = Address(x, y);
         addresses.add_address(newaddress);
-        if(rand() % 2 == 0){ //choose random route to add to
+        if(rng(2) == 0){ //choose random route to add to
            route_a.add_address(newaddress);
         } else {
            route_b.add_address(newaddress);
@@ -721,7 +4981,7 @@ void prime_ratio_test(){
         evaluate(route1, route2);
 
         for (int j = 0; j < i; j++){
-            Address random_address = available_for_prime.pick_random();
+            Address random_address = available_for_prime.pick_random(rng);
             primes.add_address(random_address);
             available_for_prime.erase(available_for_prime.index_closest_to(random_address));
         }
@@ -733,18 +4993,19 @@ void prime_ratio_test(){
     }
 }
 
-void prime_ratio_output(int num_addresses, int max_length){
+void prime_ratio_output(int num_addresses, int max_length, uint64_t seed){
     //num_adddresses is number of addresses in route
     //max_length is the maximum allowed value for coordinates
 
-    srand (time(NULL));
+    Rng rng(seed);
     Route route_a, route_b;
     AddressList addresses = {};
 
     for(int i = 0; i < num_addresses; i++){
-        Address newaddress = Address(rand() % max_length, rand() % max_length);
+        float x = rng(max_length), y = rng(max_length);
+        Address newaddress = Address(x, y);
         addresses.add_address(newaddress);
-        if(rand() % 2 == 0){ //choose random route to add to
+        if(rng(2) == 0){ //choose random route to add to
            route_a.add_address(newaddress);
         } else {
            route_b.add_address(newaddress);
@@ -763,7 +5024,7 @@ void prime_ratio_output(int num_addresses, int max_length){
         route1 = route_a; route2 = route_b;
 
         for (int j = 0; j < i; j++){
-            Address random_address = available_for_prime.pick_random();
+            Address random_address = available_for_prime.pick_random(rng);
             primes.add_address(random_address);
             available_for_prime.erase(available_for_prime.index_closest_to(random_address));
         }
@@ -776,10 +5037,10 @@ void prime_ratio_output(int num_addresses, int max_length){
     }
 }
 
-float dynamic_test1(){
+float dynamic_test1(uint64_t seed){
     // in which we simply add new prime and nonprime addresses to list 1 each day
     // leaving list 2 to do what it will with the mopt2 output (like a queue)
-    srand(time(NULL));
+    Rng rng(seed);
 
     int days = 50;
       
@@ -790,23 +5051,24 @@ float dynamic_test1(){
     Route route_a, route_b;
     AddressList addresses; // all addresses in total graph
     AddressList primes;
-    float sum_initial, sum_difference;
+    float sum_initial = 0, sum_difference = 0;
 
     for (int i = 0; i < days; i++){
         AddressList available_for_prime = route_a; //only addresses in route a can be prime
 
         float initial_total, final_total;
-        for (int j = 0; j < rand() % num_addresses ; j++){ //tack on some new addresses
-            Address newaddress = Address(rand() % max_length, rand() % max_length);
-            if(rand() % 2 == 0){
+        for (int j = 0; j < rng(num_addresses) ; j++){ //tack on some new addresses
+            float x = rng(max_length), y = rng(max_length);
+            Address newaddress = Address(x, y);
+            if(rng(2) == 0){
                 route_a.add_address(newaddress);
-                if(rand() % prime_chance == 0){
+                if(rng(prime_chance) == 0){
                     primes.add_address(newaddress);
                 }
             } else {
                 route_b.add_address(newaddress);
             }
-            //Address random_address = available_for_prime.pick_random();
+            //Address random_address = available_for_prime.pick_random(rng);
             //primes.add_address(random_address);
             //available_for_prime.erase(available_for_prime.index_closest_to(random_address));
         }
@@ -825,6 +5087,7 @@ float dynamic_test1(){
 
         sum_initial = sum_initial + initial_total;
         sum_difference = sum_difference + (final_total - initial_total);
+        STAT_DUMP("dynamic_test1 seed " + std::to_string(seed) + " day " + std::to_string(i));
 
         //at end of the day, clear routes
         route_a.clear();
@@ -834,9 +5097,10 @@ float dynamic_test1(){
     return sum_difference/sum_initial * 100;
 }
 
-float dynamic_test2(){
-    // in which I add all addresses in route_2 to route_1 on the next day and run mopt2
-    srand(time(NULL));
+float dynamic_test2(uint64_t seed){
+    // in which I add all addresses in route_2 to route_1 on the next day,
+    // re-plan route_1 around the changes and run mopt2
+    Rng rng(seed);
 
     int days = 50;
       
@@ -847,14 +5111,15 @@ float dynamic_test2(){
     Route route_a, route_b;
     AddressList addresses; // all addresses in total graph
     AddressList primes;
-    float sum_initial, sum_difference;
+    float sum_initial = 0, sum_difference = 0;
 
     for (int i = 0; i < days; i++){
 
         float initial_total, final_total;
-        for (int j = 0; j < rand() % num_addresses ; j++){ //tack on new primes into route1, nonprimes into route2
-            Address newaddress = Address(rand() % max_length, rand() % max_length);
-            if(rand() % prime_chance * 2 == 0){
+        for (int j = 0; j < rng(num_addresses) ; j++){ //tack on new primes into route1, nonprimes into route2
+            float x = rng(max_length), y = rng(max_length);
+            Address newaddress = Address(x, y);
+            if(rng(prime_chance) * 2 == 0){
                 route_a.add_address(newaddress);
                 primes.add_address(newaddress);
             } else {
@@ -870,12 +5135,14 @@ float dynamic_test2(){
         //cout << "my primes are " << endl;
         //primes.print();
         //cout << " my routes are " << endl;
+        route_a.opt2_incremental();
         route_a.multi_opt2(route_b, primes.my_addresses());
         //evaluate(route_a, route_b);
         final_total  = route_a.length() + route_b.length();
 
         sum_initial = sum_initial + initial_total;
         sum_difference = sum_difference + (final_total - initial_total);
+        STAT_DUMP("dynamic_test2 seed " + std::to_string(seed) + " day " + std::to_string(i));
 
         //at end of the day, clear routes
         route_a.clear();
@@ -887,9 +5154,10 @@ float dynamic_test2(){
     return sum_difference/sum_initial * 100;
 }
 
-float dynamic_test3(){
-    // in which I add all addresses in route_2 to route_1 on the next day and run opt2
-    srand(time(NULL));
+float dynamic_test3(uint64_t seed){
+    // in which I add all addresses in route_2 to route_1 on the next day and
+    // re-plan it with opt2, searching only around the changes
+    Rng rng(seed);
 
     int days = 50;
       
@@ -900,14 +5168,15 @@ float dynamic_test3(){
     Route route_a, route_b;
     AddressList addresses; // all addresses in total graph
     AddressList primes;
-    float sum_initial, sum_difference;
+    float sum_initial = 0, sum_difference = 0;
 
     for (int i = 0; i < days; i++){
 
         float initial_total, final_total;
-        for (int j = 0; j < rand() % num_addresses ; j++){ //tack on new primes into route1, nonprimes into route2
-            Address newaddress = Address(rand() % max_length, rand() % max_length);
-            if(rand() % prime_chance * 2 == 0){
+        for (int j = 0; j < rng(num_addresses) ; j++){ //tack on new primes into route1, nonprimes into route2
+            float x = rng(max_length), y = rng(max_length);
+            Address newaddress = Address(x, y);
+            if(rng(prime_chance) * 2 == 0){
                 route_a.add_address(newaddress);
                 primes.add_address(newaddress);
             } else {
@@ -923,12 +5192,13 @@ float dynamic_test3(){
         //cout << "my primes are " << endl;
         //primes.print();
         //cout << " my routes are " << endl;
-        route_a.opt2();
+        route_a.opt2_incremental();
         //evaluate(route_a, route_b);
         final_total  = route_a.length() + route_b.length();
 
         sum_initial = sum_initial + initial_total;
         sum_difference = sum_difference + (final_total - initial_total);
+        STAT_DUMP("dynamic_test3 seed " + std::to_string(seed) + " day " + std::to_string(i));
 
         //at end of the day, clear routes
         route_a.clear();
@@ -940,37 +5210,86 @@ float dynamic_test3(){
     return sum_difference/sum_initial * 100;
 }
 
-void rand_test(){
-    srand (time(NULL));
-    cout << rand() % 100;
-}
+float dynamic_test4(uint64_t seed){
+    // in which one route carries over from day to day: some of its stops are
+    // delivered, new ones arrive, and only the changes are re-optimized
+    Rng rng(seed);
 
+    int days = 50;
 
-int main(int argc, char** argv) {
-    //int a, b;
-    //prime_ratio_output(atoi(argv[1]), atoi(argv[2]));
-    //prime_ratio_test();
-    vector<float> outputs;
-    float mean, std;
-    for(int i = 0; i < 20; i++){
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-        outputs.push_back(dynamic_test3());
-    }
-    float N = outputs.size();
+    int num_addresses = 50;
+    int max_length = 20; // basically determines graph bound box
+    int delivered = 4; // x for 1/x where 1/x is the chance that a stop is delivered each day
+
+    Route route;
+    float sum_initial = 0, sum_difference = 0;
+
+    for (int i = 0; i < days; i++){
+
+        float initial_total, final_total;
+        for (int p = route.size() - 2; p >= 1; p--){ //deliver some of yesterday's stops
+            if(rng(delivered) == 0){
+                route.erase(p);
+            }
+        }
+        for (int j = 0; j < rng(num_addresses) ; j++){ //tack on new addresses
+            float x = rng(max_length), y = rng(max_length);
+            route.add_address(Address(x, y));
+        }
 
-    for(float x: outputs){
-        mean = mean + x;
+        initial_total = route.length();
+        route.opt2_incremental();
+        final_total = route.length();
+
+        sum_initial = sum_initial + initial_total;
+        sum_difference = sum_difference + (final_total - initial_total);
+        STAT_DUMP("dynamic_test4 seed " + std::to_string(seed) + " day " + std::to_string(i));
     }
-    mean = mean/N;
+    return sum_difference/sum_initial * 100;
+}
 
-    for(float x: outputs){
-        std = std + pow((x - mean), 2);
+void trial_runner_test(){
+    // same seed, same numbers, however many workers share the trials
+    RunningStats serial = run_trials(6, 42, dynamic_test2, 1);
+    RunningStats parallel = run_trials(6, 42, dynamic_test2, 4);
+    assert( serial.count() == 6 and parallel.count() == 6 );
+    assert( serial.mean() == parallel.mean() and serial.std() == parallel.std() );
+    assert( dynamic_test3(7) == dynamic_test3(7) );
+    RunningStats known;
+    for (double x: {2, 4, 4, 4, 5, 5, 7, 9}){
+        known.add(x);
     }
-    cout << std << endl;
-    std = pow(1./(N - 1.) * std, .5);
-    cout << mean << "," << std << endl;
-    return 0;
+    assert( known.mean() == 5 and fabs(known.std() - sqrt(32. / 7)) < 1e-12 );
 }
 
+void rand_test(uint64_t seed){
+    Rng rng(seed);
+    cout << rng(100);
+}
 
 
+int main(int argc, char** argv) {
+    //int a, b;
+    //prime_ratio_output(atoi(argv[1]), atoi(argv[2]), 1);
+    //prime_ratio_test();
+    // "bench [max_n] [path]": time the searches and write JSON results
+    if (argc > 1 and string(argv[1]) == "bench"){
+        int max_n = argc > 2 ? atoi(argv[2]) : 100000;
+        string path = argc > 3 ? argv[3] : "bench_output.json";
+        vector<BenchCase> results = run_benchmarks(max_n);
+        for (BenchCase &c: results){
+            cout << c.name << " n=" << c.n << ": median " << c.median << " s, p95 " << c.p95 << " s" << endl;
+        }
+        write_benchmarks(results, path);
+        return 0;
+    }
+#ifdef ROUTE_STATS
+    // every simulated day reports its counters and phase times
+    Instruments::open("stats_output.json");
+#endif
+    // optional first argument: base seed for the trials
+    uint64_t seed = argc > 1 ? strtoull(argv[1], NULL, 10) : 1;
+    RunningStats stats = run_trials(20, seed, dynamic_test3);
+    cout << stats.mean() << "," << stats.std() << endl;
+    return 0;
+}